@@ -0,0 +1,16 @@
+[bench.bf -- emulator throughput benchmark
+ runs 64 times a 255-iteration loop whose body copies and moves a cell
+ back and forth, prints a dot per outer iteration then a new line]
+
+++++++++[>++++++++<-]>
+[
+  >-[
+    >-[>+>+<<-]>>[<<+>>-]<<
+    [>+<-]>[<+>-]<[-]
+    <-
+  ]
+  <
+  >>>>>>++++++++[<++++++>-]<--.[-]<<<<<
+  -
+]
+++++++++++.
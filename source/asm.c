@@ -5,14 +5,45 @@
 #include "asm.h"
 #include "fatal.h"
 
+struct cached
+{
+	signed long   offset;
+	unsigned long stamp;
+	bool          used;
+	bool          dirty;
+};
+
 struct asmgen
 {
 	FILE          *file;
 	struct        { char *reg;  char prefix; } amd;
 	struct        { char *load; char *store; char prefix; } arm;
+	struct cached cache[CACHED_CELLS];
+	const char    *cell;
+	const char    *from;
+	unsigned long clock;
 	unsigned char cellwidth;
 };
 
+/* registers cells are kept in (see 'cache_cell') per width, same ones
+ * the ELF generator uses on amd64
+ */
+static const char *const CachedRegisters[2][4][CACHED_CELLS] =
+{
+	{
+		{ "%r9b", "%r10b", "%r11b", "%cl"  },
+		{ "%r9w", "%r10w", "%r11w", "%cx"  },
+		{ "%r9d", "%r10d", "%r11d", "%ecx" },
+		{ "%r9",  "%r10",  "%r11",  "%rcx" },
+	},
+	{
+		{ "w3", "w4", "w5", "w6" },
+		{ "w3", "w4", "w5", "w6" },
+		{ "w3", "w4", "w5", "w6" },
+		{ "x3", "x4", "x5", "x6" },
+	}
+};
+
 static const char *const Headers[] =
 {
 	".section .bss\n"
@@ -32,15 +63,193 @@ static const char *const Headers[] =
 	"\tadd\tx9,x9,:lo12:memory\n"
 };
 
+/* unbounded tape: reserved through mmap(2) at startup (nothing is committed
+ * until touched) and the pointer starts in the middle of it
+ */
+static const char *const UnboundedHeaders[] =
+{
+	".section .text\n"
+	".globl _start\n"
+	"_start:\n"
+	"\tmovq\t$9, %%rax\n"
+	"\txorq\t%%rdi, %%rdi\n"
+	"\tmovabsq\t$%ld, %%rsi\n"
+	"\tmovq\t$3, %%rdx\n"
+	"\tmovq\t$0x4022, %%r10\n"
+	"\tmovq\t$-1, %%r8\n"
+	"\txorq\t%%r9, %%r9\n"
+	"\tsyscall\n"
+	"\tmovabsq\t$%ld, %%r8\n"
+	"\taddq\t%%rax, %%r8\n",
+
+	".section .text\n"
+	".globl _start\n"
+	"_start:\n"
+	"\tmov\tx8, #222\n"
+	"\tmov\tx0, #0\n"
+	"\tldr\tx1, =%ld\n"
+	"\tmov\tx2, #3\n"
+	"\tmov\tx3, #0x4022\n"
+	"\tmov\tx4, #-1\n"
+	"\tmov\tx5, #0\n"
+	"\tsvc\t#0\n"
+	"\tldr\tx10, =%ld\n"
+	"\tadd\tx9, x0, x10\n"
+};
+
+/* '.' writes into 'output' instead of doing a syscall per byte, r12 / x19
+ * hold how much of it is taken (x20 points to it); 'flush' writes it out
+ * once full, before reading and at the end (see elf.c). ',' reads from
+ * 'input', r13 / x21 is the next byte and r14 / x22 its end, 'refill'
+ * reads the next block once it is empty. 'fault' writes it out as well
+ * when the program runs off the tape, then raises the signal again which
+ * takes the default action by then (SA_RESETHAND | SA_NODEFER); x86-64
+ * wants a restorer even though it never returns
+ */
+static const char *const Runtimes[] =
+{
+	".section .bss\n"
+	"\toutput: .zero %d\n"
+	"\tinput: .zero %d\n"
+	".section .data\n"
+	"\tfaulting: .quad fault, 0xc4000000, restore, 0\n"
+	".section .text\n"
+	"\tmovq\t$13, %%rax\n"
+	"\tmovq\t$11, %%rdi\n"
+	"\tleaq\tfaulting(%%rip), %%rsi\n"
+	"\txorq\t%%rdx, %%rdx\n"
+	"\tmovq\t$8, %%r10\n"
+	"\tsyscall\n"
+	"\tmovq\t$13, %%rax\n"
+	"\tmovq\t$7, %%rdi\n"
+	"\tsyscall\n"
+	"\txorl\t%%r12d, %%r12d\n"
+	"\txorl\t%%r13d, %%r13d\n"
+	"\txorl\t%%r14d, %%r14d\n",
+
+	".section .bss\n"
+	"\toutput: .skip %d\n"
+	"\tinput: .skip %d\n"
+	".section .data\n"
+	"\t.balign\t8\n"
+	"\tfaulting: .quad fault, 0xc0000000, 0, 0\n"
+	".section .text\n"
+	"\tmov\tx8, #134\n"
+	"\tmov\tx0, #11\n"
+	"\tadrp\tx1, faulting\n"
+	"\tadd\tx1, x1, :lo12:faulting\n"
+	"\tmov\tx2, #0\n"
+	"\tmov\tx3, #8\n"
+	"\tsvc\t#0\n"
+	"\tmov\tx8, #134\n"
+	"\tmov\tx0, #7\n"
+	"\tadrp\tx1, faulting\n"
+	"\tadd\tx1, x1, :lo12:faulting\n"
+	"\tsvc\t#0\n"
+	"\tmov\tx19, #0\n"
+	"\tadrp\tx20, output\n"
+	"\tadd\tx20, x20, :lo12:output\n"
+	"\tmov\tx21, #0\n"
+	"\tmov\tx22, #0\n"
+};
+
 static const char *const Footers[] =
 {
+	"\tcall\tflush\n"
 	"\tmovq\t$60, %rax\n"
 	"\tmovq\t$0, %rdi\n"
+	"\tsyscall\n"
+	"flush:\n"
+	"\ttestl\t%r12d, %r12d\n"
+	"\tjz\t1f\n"
+	"\tpushq\t%rcx\n"
+	"\tpushq\t%r11\n"
+	"\tmovq\t$1, %rax\n"
+	"\tmovq\t$1, %rdi\n"
+	"\tleaq\toutput(%rip), %rsi\n"
+	"\tmovl\t%r12d, %edx\n"
+	"\tsyscall\n"
+	"\tpopq\t%r11\n"
+	"\tpopq\t%rcx\n"
+	"\txorl\t%r12d, %r12d\n"
+	"1:\n"
+	"\tret\n"
+	"fault:\n"
+	"\tmovl\t%edi, %ebx\n"
+	"\tcall\tflush\n"
+	"\tmovq\t$39, %rax\n"
+	"\tsyscall\n"
+	"\tmovq\t%rax, %rdi\n"
+	"\tmovl\t%ebx, %esi\n"
+	"\tmovq\t$62, %rax\n"
+	"\tsyscall\n"
+	"restore:\n"
+	"\tmovq\t$15, %rax\n"
 	"\tsyscall\n",
 
+	"\tbl\tflush\n"
 	"\tmov\tx8, #93\n"
 	"\tmov\tx0, #0\n"
 	"\tsvc\t#0\n"
+	"flush:\n"
+	"\tcbz\tx19, 1f\n"
+	"\tmov\tx8, #64\n"
+	"\tmov\tx0, #1\n"
+	"\tmov\tx1, x20\n"
+	"\tmov\tx2, x19\n"
+	"\tsvc\t#0\n"
+	"\tmov\tx19, #0\n"
+	"1:\n"
+	"\tret\n"
+	"fault:\n"
+	"\tmov\tw24, w0\n"
+	"\tbl\tflush\n"
+	"\tmov\tx8, #172\n"
+	"\tsvc\t#0\n"
+	"\tmov\tw1, w24\n"
+	"\tmov\tx8, #129\n"
+	"\tsvc\t#0\n"
+};
+
+/* the next byte ends up in eax / w10, what is left on EOF is written by
+ * 'emmit_refill' right after these
+ */
+static const char *const Refills[] =
+{
+	"refill:\n"
+	"\tpushq\t%%rcx\n"
+	"\tpushq\t%%r11\n"
+	"\tmovq\t$0, %%rax\n"
+	"\tmovq\t$0, %%rdi\n"
+	"\tleaq\tinput(%%rip), %%rsi\n"
+	"\tmovq\t$%d, %%rdx\n"
+	"\tsyscall\n"
+	"\tpopq\t%%r11\n"
+	"\tpopq\t%%rcx\n"
+	"\ttestq\t%%rax, %%rax\n"
+	"\tjle\t1f\n"
+	"\tleaq\tinput(%%rip), %%r13\n"
+	"\tleaq\t(%%r13,%%rax), %%r14\n"
+	"\tmovzbl\t(%%r13), %%eax\n"
+	"\tincq\t%%r13\n"
+	"\tret\n"
+	"1:\n",
+
+	"refill:\n"
+	"\tmov\tx8, #63\n"
+	"\tmov\tx0, #0\n"
+	"\tadrp\tx1, input\n"
+	"\tadd\tx1, x1, :lo12:input\n"
+	"\tldr\tx2, =%d\n"
+	"\tsvc\t#0\n"
+	"\tcmp\tx0, #0\n"
+	"\tb.le\t1f\n"
+	"\tadrp\tx21, input\n"
+	"\tadd\tx21, x21, :lo12:input\n"
+	"\tadd\tx22, x21, x0\n"
+	"\tldrb\tw10, [x21], #1\n"
+	"\tret\n"
+	"1:\n"
 };
 
 static void get_arch_family (struct asmgen *asmg, const unsigned char cellsz, const enum arch arch)
@@ -80,6 +289,24 @@ static void amd64_emmit_inp (const struct asmgen*, const unsigned long);
 static void amd64_emmit_lbr (const struct asmgen*, const unsigned long);
 static void amd64_emmit_rbr (const struct asmgen*, const unsigned long);
 
+static void amd64_emmit_set (const struct asmgen*, const unsigned long);
+static void amd64_emmit_mul (const struct asmgen*, const unsigned long, const signed long);
+static void amd64_emmit_scan (const struct asmgen*, const unsigned long, const signed long);
+
+static struct cached *lookup_cached_cell (struct asmgen*, const signed long);
+static struct cached *cache_cell (struct asmgen*, const signed long, const bool, const enum arch);
+static void shift_cached_cells (struct asmgen*, const signed long, const enum arch);
+static void spill_cached_cells (struct asmgen*, const enum arch);
+static void point_at_tested_cell (struct asmgen*, const enum arch);
+static void emmit_load_store (const struct asmgen*, const struct cached*, const bool, const enum arch);
+static const char *cached_register (const struct asmgen*, const struct cached*, const unsigned char, const enum arch);
+static void drop_cached_cell (struct asmgen*, const signed long, const enum arch);
+static void emmit_literal (const struct asmgen*, const char*, const unsigned long, const size_t);
+static void emmit_refill (const struct asmgen*, const enum arch, const enum eof);
+
+static void amd64_emmit_print (const struct asmgen*, const unsigned long, const size_t);
+static void arm64_emmit_print (const struct asmgen*, const unsigned long, const size_t);
+
 static void arm64_emmit_inc (const struct asmgen*, const unsigned long);
 static void arm64_emmit_dec (const struct asmgen*, const unsigned long);
 
@@ -92,15 +319,25 @@ static void arm64_emmit_inp (const struct asmgen*, const unsigned long);
 static void arm64_emmit_lbr (const struct asmgen*, const unsigned long);
 static void arm64_emmit_rbr (const struct asmgen*, const unsigned long);
 
-void asm_gen_asm (const struct stream *stream, const char *filename, const unsigned int tapesz, const unsigned char cellsz, const enum arch arch)
+static void arm64_emmit_set (const struct asmgen*, const unsigned long);
+static void arm64_emmit_mul (const struct asmgen*, const unsigned long, const signed long);
+static void arm64_emmit_scan (const struct asmgen*, const unsigned long, const signed long);
+
+void asm_gen_asm (const struct stream *stream, const char *filename, const unsigned int tapesz, const unsigned char cellsz, const enum arch arch, const bool unbounded, const enum eof eof)
 {
 	struct asmgen asmg = { .file = fopen(filename, "w") };
 	if (!asmg.file) { fatal_file_ops(filename); }
 
 	get_arch_family(&asmg, cellsz, arch);
-	fprintf(asmg.file, Headers[arch], (unsigned long) (tapesz * cellsz));
+	if (unbounded) { fprintf(asmg.file, UnboundedHeaders[arch], UNBOUNDED_TAPE_LENGTH, UNBOUNDED_TAPE_LENGTH / 2); }
+	else           { fprintf(asmg.file, Headers[arch], (unsigned long) (tapesz * cellsz)); }
+	fprintf(asmg.file, Runtimes[arch], OUTPUT_BUFFER_LENGTH, INPUT_BUFFER_LENGTH);
 
 	typedef void (*emmiter_t) (const struct asmgen*, const unsigned long);
+	typedef void (*mul_emmiter_t) (const struct asmgen*, const unsigned long, const signed long);
+
+	const mul_emmiter_t mulemmiter  = (arch == ARCH_AMD64) ? amd64_emmit_mul  : arm64_emmit_mul;
+	const mul_emmiter_t scanemmiter = (arch == ARCH_AMD64) ? amd64_emmit_scan : arm64_emmit_scan;
 
 	const emmiter_t emmiters[] =
 	{
@@ -112,31 +349,228 @@ void asm_gen_asm (const struct stream *stream, const char *filename, const unsig
 		(arch == ARCH_AMD64) ? amd64_emmit_inp : arm64_emmit_inp,
 		(arch == ARCH_AMD64) ? amd64_emmit_lbr : arm64_emmit_lbr,
 		(arch == ARCH_AMD64) ? amd64_emmit_rbr : arm64_emmit_rbr,
+		(arch == ARCH_AMD64) ? amd64_emmit_set : arm64_emmit_set,
 	};
 
 	for (size_t i = 0; i < stream->length; i++)
 	{
 		const struct token *token = &stream->stream[i];
-		switch (token->meta.mnemonic)
+		switch (token->mnemonic)
 		{
-			case '+': emmiters[0] (&asmg, token->groupSize); break;
-			case '-': emmiters[1] (&asmg, token->groupSize); break;
-			case '>': emmiters[2] (&asmg, token->groupSize); break;
-			case '<': emmiters[3] (&asmg, token->groupSize); break;
-			case '.': emmiters[4] (&asmg, token->groupSize); break;
-			case ',': emmiters[5] (&asmg, token->groupSize); break;
-			case '[': emmiters[6] (&asmg, token->nolbl);     break;
-			case ']': emmiters[7] (&asmg, token->nolbl);     break;
+			case '+': cache_cell(&asmg, token->offset, true, arch)->dirty = true;  emmiters[0] (&asmg, token->groupSize); break;
+			case '-': cache_cell(&asmg, token->offset, true, arch)->dirty = true;  emmiters[1] (&asmg, token->groupSize); break;
+			case '>': shift_cached_cells(&asmg, (signed long) token->groupSize, arch);  emmiters[2] (&asmg, token->groupSize); break;
+			case '<': shift_cached_cells(&asmg, -(signed long) token->groupSize, arch); emmiters[3] (&asmg, token->groupSize); break;
+			case '.': asmg.cell = cached_register(&asmg, cache_cell(&asmg, 0, true, arch), 1, arch); emmiters[4] (&asmg, token->groupSize); break;
+			case ',': drop_cached_cell(&asmg, 0, arch);  emmiters[5] (&asmg, token->groupSize); break;
+			case '[': point_at_tested_cell(&asmg, arch); emmiters[6] (&asmg, token->nolbl);     break;
+			case ']': point_at_tested_cell(&asmg, arch); emmiters[7] (&asmg, token->nolbl);     break;
+
+			case MNEMONIC_SET: cache_cell(&asmg, token->offset, false, arch)->dirty = true; emmiters[8] (&asmg, token->groupSize); break;
+			case MNEMONIC_MUL:
+			{
+				/* both cells end up cached, the current one was used last
+				 * so it is not the one making room for the other
+				 */
+				asmg.from = cached_register(&asmg, cache_cell(&asmg, 0, true, arch), (cellsz == 8) ? 8 : 4, arch);
+				cache_cell(&asmg, token->offset, true, arch)->dirty = true;
+				mulemmiter(&asmg, token->groupSize, token->offset);
+				break;
+			}
+			case MNEMONIC_SCAN: spill_cached_cells(&asmg, arch); scanemmiter (&asmg, token->nolbl, token->offset); break;
+			case MNEMONIC_PRINT:
+			{
+				spill_cached_cells(&asmg, arch);
+				emmit_literal(&asmg, stream->literals + token->offset, token->groupSize, i);
+				if (arch == ARCH_AMD64) { amd64_emmit_print(&asmg, token->groupSize, i); }
+				else                    { arm64_emmit_print(&asmg, token->groupSize, i); }
+				break;
+			}
 		}
 	}
 
 	fprintf(asmg.file, "%s", Footers[arch]);
+	emmit_refill(&asmg, arch, eof);
 	if (fclose(asmg.file)) { fatal_file_ops(filename); }
 }
 
-static void amd64_emmit_inc (const struct asmgen *asmg, const unsigned long group) { fprintf(asmg->file, "\tadd%c\t$%ld, (%%r8)\n", asmg->amd.prefix, group); }
+static struct cached *lookup_cached_cell (struct asmgen *asmg, const signed long offset)
+{
+	for (unsigned int i = 0; i < CACHED_CELLS; i++)
+	{
+		if (asmg->cache[i].used && asmg->cache[i].offset == offset) { return &asmg->cache[i]; }
+	}
+	return NULL;
+}
+
+static struct cached *cache_cell (struct asmgen *asmg, const signed long offset, const bool load, const enum arch arch)
+{
+	/* same as the ELF generator (see elf.c): cells are kept in registers
+	 * within straight-line code, 'cell' names the register of the one
+	 * asked for. Cells may be away from the pointer (see opt.c)
+	 */
+	struct cached *cell = lookup_cached_cell(asmg, offset);
+	if (cell == NULL)
+	{
+		cell = &asmg->cache[0];
+		for (unsigned int i = 0; i < CACHED_CELLS && cell->used; i++)
+		{
+			if (!asmg->cache[i].used || asmg->cache[i].stamp < cell->stamp) { cell = &asmg->cache[i]; }
+		}
+
+		if (cell->used && cell->dirty) { emmit_load_store(asmg, cell, false, arch); }
+		cell->used   = true;
+		cell->dirty  = false;
+		cell->offset = offset;
+
+		if (load) { emmit_load_store(asmg, cell, true, arch); }
+	}
+
+	cell->stamp = ++asmg->clock;
+	asmg->cell  = cached_register(asmg, cell, asmg->cellwidth, arch);
+	return cell;
+}
+
+static void shift_cached_cells (struct asmgen *asmg, const signed long cells, const enum arch arch)
+{
+	/* cached cells follow the pointer, those too far from where it lands
+	 * are written back first
+	 */
+	for (unsigned int i = 0; i < CACHED_CELLS; i++)
+	{
+		struct cached *cell = &asmg->cache[i];
+		if (!cell->used) { continue; }
+
+		const signed long disp = (cell->offset - cells) * asmg->cellwidth;
+		if (disp < -CACHE_WINDOW || disp > CACHE_WINDOW)
+		{
+			if (cell->dirty) { emmit_load_store(asmg, cell, false, arch); }
+			cell->used = false;
+		}
+		cell->offset -= cells;
+	}
+}
+
+static void spill_cached_cells (struct asmgen *asmg, const enum arch arch)
+{
+	for (unsigned int i = 0; i < CACHED_CELLS; i++)
+	{
+		if (asmg->cache[i].used && asmg->cache[i].dirty) { emmit_load_store(asmg, &asmg->cache[i], false, arch); }
+		asmg->cache[i].used = false;
+	}
+}
+
+static void drop_cached_cell (struct asmgen *asmg, const signed long offset, const enum arch arch)
+{
+	/* for ',', which writes the cell in memory (and reads it back there
+	 * when EOF leaves it unchanged); 'refill' keeps the other registers
+	 */
+	struct cached *cell = lookup_cached_cell(asmg, offset);
+	if (cell == NULL) { return; }
+
+	if (cell->dirty) { emmit_load_store(asmg, cell, false, arch); }
+	cell->used = false;
+}
+
+static void point_at_tested_cell (struct asmgen *asmg, const enum arch arch)
+{
+	/* loop ends join other code, cached cells are written back and 'cell'
+	 * is what the test looks at: the register the current cell is cached
+	 * in if any (masked to the cell width on arm64), memory otherwise
+	 */
+	const struct cached *cached = lookup_cached_cell(asmg, 0);
+	const char *reg = cached ? cached_register(asmg, cached, asmg->cellwidth, arch) : NULL;
+	spill_cached_cells(asmg, arch);
+
+	if (arch == ARCH_AMD64)
+	{
+		asmg->cell = reg ? reg : "(%r8)";
+		return;
+	}
+
+	asmg->cell = (asmg->arm.prefix == 'x') ? "x10" : "w10";
+	if (reg == NULL)                { fprintf(asmg->file, "\t%s\t%s, [x9]\n", asmg->arm.load, asmg->cell); }
+	else if (asmg->cellwidth < 4)   { fprintf(asmg->file, "\tand\tw10, %s, #%s\n", reg, (asmg->cellwidth == 1) ? "0xff" : "0xffff"); }
+	else                            { asmg->cell = reg; }
+}
+
+static void emmit_load_store (const struct asmgen *asmg, const struct cached *cell, const bool load, const enum arch arch)
+{
+	/* loads zero extend narrow cells, stores only write the cell width;
+	 * arm64 needs the displacement in a register first
+	 */
+	const signed long disp = cell->offset * asmg->cellwidth;
+	const char *reg = cached_register(asmg, cell, asmg->cellwidth, arch);
+
+	if (arch == ARCH_AMD64)
+	{
+		char at[32];
+		if (disp) { snprintf(at, sizeof(at), "%ld(%%r8)", disp); }
+		else      { snprintf(at, sizeof(at), "(%%r8)"); }
+
+		static const char *const loads[] = { NULL, "movzbl", "movzwl", NULL, "movl", NULL, NULL, NULL, "movq" };
+		if (load) { fprintf(asmg->file, "\t%s\t%s, %s\n", loads[asmg->cellwidth], at, cached_register(asmg, cell, (asmg->cellwidth == 8) ? 8 : 4, arch)); }
+		else      { fprintf(asmg->file, "\tmov%c\t%s, %s\n", asmg->amd.prefix, reg, at); }
+		return;
+	}
+
+	if (disp) { fprintf(asmg->file, "\tldr\tx12, =%ld\n", disp); }
+	fprintf(asmg->file, "\t%s\t%s, %s\n", load ? asmg->arm.load : asmg->arm.store, reg, disp ? "[x9, x12]" : "[x9]");
+}
+
+static const char *cached_register (const struct asmgen *asmg, const struct cached *cell, const unsigned char width, const enum arch arch)
+{
+	const unsigned int pick = (width == 8) ? 3 : (width >> 1);
+	return CachedRegisters[arch][pick][cell - asmg->cache];
+}
+
+static void emmit_literal (const struct asmgen *asmg, const char *literal, const unsigned long length, const size_t id)
+{
+	/* bytes written by '"' (see opt.c) go into .rodata as 'LP<id>'
+	 */
+	fprintf(asmg->file, ".section .rodata\nLP%zu:", id);
+	for (unsigned long i = 0; i < length; i++)
+	{
+		fprintf(asmg->file, "%s%d", (i % 16) ? ", " : "\n\t.byte\t", (unsigned char) literal[i]);
+	}
+	fprintf(asmg->file, "\n.section .text\n");
+}
+
+static void emmit_refill (const struct asmgen *asmg, const enum arch arch, const enum eof eof)
+{
+	/* on EOF the cell is read back (unchanged), zero or all ones
+	 */
+	fprintf(asmg->file, Refills[arch], INPUT_BUFFER_LENGTH);
+	if (arch == ARCH_AMD64)
+	{
+		static const char *const keep[] = { "movzbl\t(%r8), %eax", "movzwl\t(%r8), %eax", "movl\t(%r8), %eax", "movq\t(%r8), %rax" };
+		const char *value = (eof == EOF_ZERO)      ? "xorl\t%eax, %eax"
+		                  : (eof == EOF_MINUS_ONE) ? "movq\t$-1, %rax"
+		                  : keep[(asmg->cellwidth == 8) ? 3 : asmg->cellwidth / 2];
+		fprintf(asmg->file, "\t%s\n\tret\n", value);
+		return;
+	}
+
+	if (eof == EOF_UNCHANGED) { fprintf(asmg->file, "\t%s\t%c10, [x9]\n", asmg->arm.load, asmg->arm.prefix); }
+	else                      { fprintf(asmg->file, "\tmov\tx10, #%d\n", (eof == EOF_ZERO) ? 0 : -1); }
+	fprintf(asmg->file, "\tret\n");
+}
 
-static void amd64_emmit_dec (const struct asmgen *asmg, const unsigned long group) { fprintf(asmg->file, "\tsub%c\t$%ld, (%%r8)\n", asmg->amd.prefix, group); }
+static void amd64_emmit_print (const struct asmgen *asmg, const unsigned long length, const size_t id)
+{
+	static const char *const template =
+		"\tcall\tflush\n"
+		"\tmovq\t$1, %%rax\n"
+		"\tmovq\t$1, %%rdi\n"
+		"\tleaq\tLP%zu(%%rip), %%rsi\n"
+		"\tmovq\t$%ld, %%rdx\n"
+		"\tsyscall\n";
+	fprintf(asmg->file, template, id, length);
+}
+
+static void amd64_emmit_inc (const struct asmgen *asmg, const unsigned long group) { fprintf(asmg->file, "\tadd%c\t$%ld, %s\n", asmg->amd.prefix, group, asmg->cell); }
+
+static void amd64_emmit_dec (const struct asmgen *asmg, const unsigned long group) { fprintf(asmg->file, "\tsub%c\t$%ld, %s\n", asmg->amd.prefix, group, asmg->cell); }
 
 static void amd64_emmit_nxt (const struct asmgen *asmg, const unsigned long group) { fprintf(asmg->file, "\taddq\t$%ld, %%r8\n", group * asmg->cellwidth); }
 
@@ -144,89 +578,177 @@ static void amd64_emmit_prv (const struct asmgen *asmg, const unsigned long grou
 
 static void amd64_emmit_out (const struct asmgen *asmg, const unsigned long group)
 {
+	/* 'cell' is the low byte of the register the cell is cached in
+	 */
 	static const char *const template =
-		"\tmovq\t$1, %rax\n"
-		"\tmovq\t$1, %rdi\n"
-		"\tmovq\t$1, %rdx\n"
-		"\tmovq\t%r8, %rsi\n"
-		"\tsyscall\n";
+		"\tmovb\t%s, output(%%r12)\n"
+		"\tincl\t%%r12d\n"
+		"\tcmpl\t$%d, %%r12d\n"
+		"\tjne\t1f\n"
+		"\tcall\tflush\n"
+		"1:\n";
 	for (unsigned long i = 0; i < group; i++)
 	{
-		fprintf(asmg->file, "%s", template);
+		fprintf(asmg->file, template, asmg->cell, OUTPUT_BUFFER_LENGTH);
 	}
 }
 
 static void amd64_emmit_inp (const struct asmgen *asmg, const unsigned long group)
 {
+	/* only an empty buffer goes through 'refill', what was written so far
+	 * goes out before waiting on input
+	 */
 	static const char *const template =
-		"\tmovq\t$0, %rax\n"
-		"\tmovq\t$0, %rdi\n"
-		"\tmovq\t$1, %rdx\n"
-		"\tmovq\t%r8, %rsi\n"
-		"\tsyscall\n";
+		"\tcmpq\t%%r14, %%r13\n"
+		"\tje\t1f\n"
+		"\tmovzbl\t(%%r13), %%eax\n"
+		"\tincq\t%%r13\n"
+		"\tjmp\t2f\n"
+		"1:\n"
+		"\tcall\tflush\n"
+		"\tcall\trefill\n"
+		"2:\n"
+		"\tmov%c\t%%%s, (%%r8)\n";
 	for (unsigned long i = 0; i < group; i++)
 	{
-		fprintf(asmg->file, "%s", template);
+		fprintf(asmg->file, template, asmg->amd.prefix, asmg->amd.reg);
 	}
 }
 
 static void amd64_emmit_lbr (const struct asmgen *asmg, const unsigned long branch)
+{
+	/* the test is at the bottom (see 'amd64_emmit_rbr'), this one only
+	 * guards the way in, the body starts on a cache line of its own
+	 */
+	static const char *const template =
+		"\tcmp%c\t$0, %s\n"
+		"\tje\tLE%ld\n"
+		"\t.p2align 6\n"
+		"LB%ld:\n";
+	fprintf(asmg->file, template, asmg->amd.prefix, asmg->cell, branch, branch);
+}
+
+static void amd64_emmit_rbr (const struct asmgen *asmg, const unsigned long branch)
+{
+	static const char *const template =
+		"\tcmp%c\t$0, %s\n"
+		"\tjne\tLB%ld\n"
+		"LE%ld:\n";
+	fprintf(asmg->file, template, asmg->amd.prefix, asmg->cell, branch, branch);
+}
+
+static void amd64_emmit_set (const struct asmgen *asmg, const unsigned long value)
 {
+	if (asmg->amd.prefix == 'q')
+	{
+		fprintf(asmg->file, "\tmovabsq\t$%ld, %s\n", value, asmg->cell);
+		return;
+	}
+	fprintf(asmg->file, "\tmov%c\t$%ld, %s\n", asmg->amd.prefix, value, asmg->cell);
+}
+
+static void amd64_emmit_mul (const struct asmgen *asmg, const unsigned long factor, const signed long offset)
+{
+	/* both cells are cached by now (see 'asm_gen_asm'), 'from' is the
+	 * current one and 'cell' the one at 'offset'
+	 */
+	(void) offset;
 	if (asmg->amd.prefix == 'q')
 	{
 		static const char *const template =
-			"LB%ld:\n"
-			"\tmovq\t(%r8), %%rax\n"
-			"\tcmpq\t$0, %%rax\n"
-			"\tje\tLE%ld\n";
-		fprintf(asmg->file, template, branch, branch);
+			"\tmovq\t%s, %%rax\n"
+			"\tmovabsq\t$%ld, %%rdx\n"
+			"\timulq\t%%rdx, %%rax\n"
+			"\taddq\t%%rax, %s\n";
+		fprintf(asmg->file, template, asmg->from, (signed long) factor, asmg->cell);
 		return;
 	}
 
+	/* the product is computed on 32 bits, only the cell width is stored
+	 */
 	static const char *const template =
-		"LB%ld:\n"
-		"\tmovzbl\t(%r8), %%eax\n"
-		"\tcmp%c\t$0, %%%s\n"
-		"\tje\tLE%ld\n";
-	fprintf(asmg->file, template, branch, asmg->amd.prefix, asmg->amd.reg, branch);
+		"\tmovl\t%s, %%eax\n"
+		"\timull\t$%d, %%eax, %%eax\n"
+		"\tadd%c\t%%%s, %s\n";
+	fprintf(asmg->file, template, asmg->from, (int) (unsigned int) factor, asmg->amd.prefix, asmg->amd.reg, asmg->cell);
 }
 
-static void amd64_emmit_rbr (const struct asmgen *asmg, const unsigned long branch)
+static void amd64_emmit_scan (const struct asmgen *asmg, const unsigned long branch, const signed long stride)
 {
+	/* same code the ELF generator produces (see elf.c), byte cells walked
+	 * one at a time are searched with sse2 on aligned blocks
+	 */
+	if (asmg->cellwidth == 1 && (stride == 1 || stride == -1))
+	{
+		static const char *const template =
+			"\tmovl\t%%r8d, %%ecx\n"
+			"\tandl\t$15, %%ecx\n"
+			"\tmovq\t%%r8, %%rax\n"
+			"\tandq\t$-16, %%rax\n"
+			"\tpxor\t%%xmm1, %%xmm1\n"
+			"\tmovdqa\t(%%rax), %%xmm0\n"
+			"\tpcmpeqb\t%%xmm1, %%xmm0\n"
+			"\tpmovmskb\t%%xmm0, %%edx\n"
+			"%s"
+			"\tandl\t%%esi, %%edx\n"
+			"\tjnz\tLZ%ld\n"
+			"LS%ld:\n"
+			"\t%s\t$16, %%rax\n"
+			"\tmovdqa\t(%%rax), %%xmm0\n"
+			"\tpcmpeqb\t%%xmm1, %%xmm0\n"
+			"\tpmovmskb\t%%xmm0, %%edx\n"
+			"\ttestl\t%%edx, %%edx\n"
+			"\tjz\tLS%ld\n"
+			"LZ%ld:\n"
+			"\t%s\t%%edx, %%edx\n"
+			"\tleaq\t(%%rax,%%rdx), %%r8\n";
+
+		const bool forward = (stride == 1);
+		const char *mask = forward ? "\tmovl\t$-1, %esi\n\tshll\t%cl, %esi\n" : "\tmovl\t$2, %esi\n\tshll\t%cl, %esi\n\tdecl\t%esi\n";
+
+		fprintf(asmg->file, template, mask, branch, branch, forward ? "addq" : "subq", branch, branch, forward ? "bsfl" : "bsrl");
+		return;
+	}
+
 	static const char *const template =
-		"\tjmp\tLB%ld\n"
-		"LE%ld:\n";
-	fprintf(asmg->file, template, branch, branch);
+		"LS%ld:\n"
+		"\tcmp%c\t$0, (%%r8)\n"
+		"\tje\tLZ%ld\n"
+		"\taddq\t$%ld, %%r8\n"
+		"\tjmp\tLS%ld\n"
+		"LZ%ld:\n";
+	fprintf(asmg->file, template, branch, asmg->amd.prefix, branch, stride * asmg->cellwidth, branch, branch);
 }
 
 static void arm64_emmit_inc (const struct asmgen *asmg, const unsigned long group)
 {
+	/* on the register the cell is cached in (see 'cache_cell'), an
+	 * immediate takes 12 bits
+	 */
+	if (group < 4096)
+	{
+		fprintf(asmg->file, "\tadd\t%s, %s, #%ld\n", asmg->cell, asmg->cell, group);
+		return;
+	}
+
 	static const char *const template =
-		"\t%s\t%c10, [x9]\n"
-		"\tmov\t%c11, #%ld\n"
-		"\tadd\t%c10, %c10, %c11\n"
-		"\t%s\t%c10, [x9]\n";
-	fprintf(
-		asmg->file, template, asmg->arm.load, asmg->arm.prefix,
-		asmg->arm.prefix, group,
-		asmg->arm.prefix, asmg->arm.prefix, asmg->arm.prefix,
-		asmg->arm.store, asmg->arm.prefix
-	);
+		"\tldr\t%c11, =%ld\n"
+		"\tadd\t%s, %s, %c11\n";
+	fprintf(asmg->file, template, asmg->arm.prefix, group, asmg->cell, asmg->cell, asmg->arm.prefix);
 }
 
 static void arm64_emmit_dec (const struct asmgen *asmg, const unsigned long group)
 {
+	if (group < 4096)
+	{
+		fprintf(asmg->file, "\tsub\t%s, %s, #%ld\n", asmg->cell, asmg->cell, group);
+		return;
+	}
+
 	static const char *const template =
-		"\t%s\t%c10, [x9]\n"
-		"\tmov\t%c11, #%ld\n"
-		"\tsub\t%c10, %c10, %c11\n"
-		"\t%s\t%c10, [x9]\n";
-	fprintf(
-		asmg->file, template, asmg->arm.load, asmg->arm.prefix,
-		asmg->arm.prefix, group,
-		asmg->arm.prefix, asmg->arm.prefix, asmg->arm.prefix,
-		asmg->arm.store, asmg->arm.prefix
-	);
+		"\tldr\t%c11, =%ld\n"
+		"\tsub\t%s, %s, %c11\n";
+	fprintf(asmg->file, template, asmg->arm.prefix, group, asmg->cell, asmg->cell, asmg->arm.prefix);
 }
 
 static void arm64_emmit_nxt (const struct asmgen *asmg, const unsigned long group)
@@ -248,45 +770,99 @@ static void arm64_emmit_prv (const struct asmgen *asmg, const unsigned long grou
 static void arm64_emmit_out (const struct asmgen *asmg, const unsigned long group)
 {
 	static const char *const template =
-		"\tmov\tx8, #64\n"
-		"\tmov\tx0, #1\n"
-		"\tmov\tx1, x9\n"
-		"\tmov\tx2, #1\n"
-		"\tsvc\t#0\n";
+		"\tstrb\t%s, [x20, x19]\n"
+		"\tadd\tx19, x19, #1\n"
+		"\tcmp\tx19, #%d\n"
+		"\tb.ne\t1f\n"
+		"\tbl\tflush\n"
+		"1:\n";
 	for (unsigned long i = 0; i < group; i++)
 	{
-		fprintf(asmg->file, "%s", template);
+		fprintf(asmg->file, template, asmg->cell, OUTPUT_BUFFER_LENGTH);
 	}
 }
 
 static void arm64_emmit_inp (const struct asmgen *asmg, const unsigned long group)
 {
 	static const char *const template =
-		"\tmov\tx8, #63\n"
-		"\tmov\tx0, #0\n"
-		"\tmov\tx1, x9\n"
-		"\tmov\tx2, #1\n"
-		"\tsvc\t#0\n";
+		"\tcmp\tx21, x22\n"
+		"\tb.eq\t1f\n"
+		"\tldrb\tw10, [x21], #1\n"
+		"\tb\t2f\n"
+		"1:\n"
+		"\tbl\tflush\n"
+		"\tbl\trefill\n"
+		"2:\n"
+		"\t%s\t%c10, [x9]\n";
 	for (unsigned long i = 0; i < group; i++)
 	{
-		fprintf(asmg->file, "%s", template);
+		fprintf(asmg->file, template, asmg->arm.store, asmg->arm.prefix);
 	}
 }
 
 static void arm64_emmit_lbr (const struct asmgen *asmg, const unsigned long branch)
 {
-	static const char *template =
-		"LB%ld:\n"
-		"\t%s\t%c10, [x9]\n"
-		"\tcmp\t%c10, #0\n"
-		"\tbeq\tLE%d\n";
-	fprintf(asmg->file, template, branch, asmg->arm.load, asmg->arm.prefix, asmg->arm.prefix, branch);
+	/* same shape as 'amd64_emmit_lbr'
+	 */
+	static const char *const template =
+		"\tcbz\t%s, LE%ld\n"
+		"\t.p2align 6\n"
+		"LB%ld:\n";
+	fprintf(asmg->file, template, asmg->cell, branch, branch);
 }
 
 static void arm64_emmit_rbr (const struct asmgen *asmg, const unsigned long branch)
 {
 	static const char *const template =
-		"\tb\tLB%ld\n"
+		"\tcbnz\t%s, LB%ld\n"
 		"LE%ld:\n";
-	fprintf(asmg->file, template, branch, branch);
+	fprintf(asmg->file, template, asmg->cell, branch, branch);
+}
+
+static void arm64_emmit_set (const struct asmgen *asmg, const unsigned long value)
+{
+	if (value == 0)
+	{
+		fprintf(asmg->file, "\tmov\t%s, %czr\n", asmg->cell, asmg->arm.prefix);
+		return;
+	}
+	fprintf(asmg->file, "\tldr\t%s, =%ld\n", asmg->cell, value);
+}
+
+static void arm64_emmit_mul (const struct asmgen *asmg, const unsigned long factor, const signed long offset)
+{
+	/* same as 'amd64_emmit_mul'
+	 */
+	(void) offset;
+	const unsigned long mask = (asmg->arm.prefix == 'x') ? ~0UL : 0xffffffffUL;
+	static const char *const template =
+		"\tldr\t%c13, =%lu\n"
+		"\tmadd\t%s, %s, %c13, %s\n";
+	fprintf(asmg->file, template, asmg->arm.prefix, factor & mask, asmg->cell, asmg->from, asmg->arm.prefix, asmg->cell);
+}
+
+static void arm64_emmit_scan (const struct asmgen *asmg, const unsigned long branch, const signed long stride)
+{
+	static const char *const template =
+		"LS%ld:\n"
+		"\t%s\t%c10, [x9]\n"
+		"\tcbz\t%c10, LZ%ld\n"
+		"\tldr\tx11, =%ld\n"
+		"\tadd\tx9, x9, x11\n"
+		"\tb\tLS%ld\n"
+		"LZ%ld:\n";
+	fprintf(asmg->file, template, branch, asmg->arm.load, asmg->arm.prefix, asmg->arm.prefix, branch, stride * asmg->cellwidth, branch, branch);
+}
+
+static void arm64_emmit_print (const struct asmgen *asmg, const unsigned long length, const size_t id)
+{
+	static const char *const template =
+		"\tbl\tflush\n"
+		"\tmov\tx8, #64\n"
+		"\tmov\tx0, #1\n"
+		"\tadrp\tx1, LP%zu\n"
+		"\tadd\tx1, x1, :lo12:LP%zu\n"
+		"\tldr\tx2, =%ld\n"
+		"\tsvc\t#0\n";
+	fprintf(asmg->file, template, id, id, length);
 }
@@ -12,11 +12,32 @@
 #define BC_DEFAULT_O   0
 #define BC_DEFAULT_d   100
 #define BC_DEFAULT_g   10
+#define BC_DEFAULT_x   1000
+#define BC_DEFAULT_P   10
+#define BC_DEFAULT_J   1
+#define BC_DEFAULT_p   (1UL << 24)
 
 #define STREAM_GROWTH_FACTOR     128
-#define OPENLOOP_STACK_MAX_CAP   256
+#define OPENLOOP_GROWTH_FACTOR   256
+#define UNBOUNDED_TAPE_LENGTH    (1UL << 36)
+#define CACHED_CELLS             4
+#define CACHE_WINDOW             127
+#define OUTPUT_BUFFER_LENGTH     4096
+#define INPUT_BUFFER_LENGTH      65536
 #define CHECK_POINTER(ptr, a)    do { if (ptr) break; fatal_memory_ops(a); } while (0)
 
+/* mnemonics synthesised by the optimiser (opt.c), none of them can be
+ * found within a source
+ *   '=': the current cell is set to 'groupSize'
+ *   '*': cell['offset'] += current cell * 'groupSize' (the factor)
+ *   '^': the pointer moves 'offset' cells at a time until a zero cell
+ *   '"': writes 'groupSize' bytes from the stream literals at 'offset'
+ */
+#define MNEMONIC_SET             '='
+#define MNEMONIC_MUL             '*'
+#define MNEMONIC_SCAN            '^'
+#define MNEMONIC_PRINT           '"'
+
 #include <stdio.h>
 #include <stdbool.h>
 
@@ -26,25 +47,57 @@ enum arch
 	ARCH_ARM64 = 1,
 };
 
+/* What ',' leaves on the cell once the input is over
+ */
+enum eof
+{
+	EOF_UNCHANGED = 0,
+	EOF_ZERO      = 1,
+	EOF_MINUS_ONE = 2,
+};
+
+/* Tokens only carry what is needed to run them, where each came from in the
+ * source (only needed when reporting) lives in 'stream->where' at the same
+ * position
+ */
 struct token
 {
 	unsigned long groupSize;
-	unsigned long nolbl;
-	struct
-	{
-		char           *context;
-		unsigned short numline;
-		unsigned short offline;
-		char           mnemonic;
-	} meta;
+	signed long   offset;
+	unsigned int  nolbl;
+	char          mnemonic;
+};
+
+struct location
+{
+	char          *context;
+	unsigned long numline;
+	unsigned long offline;
 };
 
 struct stream
 {
-	struct token  *stream;
+	struct token    *stream;
+	struct location *where;
+	char            *literals;
+	size_t          length;
+	size_t          capacity;
+	size_t          noliterals;
+	unsigned long   nonested;
+};
+
+/* Machine state left by running the program at compile time (see emu.c):
+ * the tape up to its last non-zero cell, what got written, the token to
+ * carry on from and where the pointer was
+ */
+struct image
+{
+	unsigned char *tape;
+	char          *output;
 	size_t        length;
-	size_t        capacity;
-	unsigned long nonested;
+	size_t        outlen;
+	size_t        resume;
+	signed long   at;
 };
 
 struct bc
@@ -58,13 +111,31 @@ struct bc
 		unsigned int   tapesz;
 		unsigned int   display;
 		unsigned int   group;
+		unsigned int   hotness;
+		unsigned int   profileTop;
+		unsigned int   jobs;
 		unsigned char  cellsz;
 		char           *compile;
 		char           *output;
 		char           *source;
+		char           *checkpoint;
+		char           *resume;
+		unsigned long  every;
+		unsigned long  budget;
+		bool           assembly;
+		bool           noopt;
 		bool           safeMode;
 		bool           emulate;
+		bool           threaded;
+		bool           jit;
+		bool           tiered;
+		bool           profile;
+		bool           guard;
+		bool           unbounded;
+		bool           preeval;
+		bool           streaming;
 		enum arch      arch;
+		enum eof       eof;
 	} args;
 };
 
@@ -91,7 +91,7 @@ static void handle_freeword (const char*, struct Cxa*);
 
 static void store_positional_argument (struct Cxa*, const char*);
 
-struct Cxa *cxa_execute (const unsigned char argc, char **argv, struct CxaFlag *flags, const char *projectName)
+struct Cxa *cxa_execute (const int argc, char **argv, struct CxaFlag *flags, const char *projectName)
 {
 	struct Cxa *cxa = (struct Cxa*) calloc(1, sizeof(struct Cxa));
 	cxa->positional = (char**)      calloc(CXA_POS_ARGS_GROWTH_FAC, sizeof(char*));
@@ -107,7 +107,7 @@ struct Cxa *cxa_execute (const unsigned char argc, char **argv, struct CxaFlag *
 
 	bool endOfArgs = false;
 
-	for (unsigned char i = 1; i < argc; i++)
+	for (int i = 1; i < argc; i++)
 	{
 		const char *this = argv[i];
 		const size_t len = strlen(this);
@@ -129,6 +129,15 @@ struct Cxa *cxa_execute (const unsigned char argc, char **argv, struct CxaFlag *
 		}
 		else if (len == 1 && *this == '-')
 		{
+			/* a lone dash names stdin, taken as any other word
+			 */
+			handle_freeword(this, cxa);
+		}
+		else if (len >  1 && *this == '-' && LastSeen && isdigit(this[1]))
+		{
+			/* a negative number is the argument of the flag before it
+			 */
+			handle_freeword(this, cxa);
 		}
 		else if (len >  1 && *this == '-')
 		{
@@ -78,7 +78,7 @@ struct Cxa
 	unsigned long cap;
 };
 
-struct Cxa *cxa_execute (const unsigned char, char**, struct CxaFlag*, const char*);
+struct Cxa *cxa_execute (const int, char**, struct CxaFlag*, const char*);
 void cxa_print_usage (const char*, const struct CxaFlag*);
 void cxa_clean (struct Cxa*);
 
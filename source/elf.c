@@ -4,10 +4,15 @@
  */
 #include "elf.h"
 #include "fatal.h"
+#include "lexpa.h"
 
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
 
 #define BUFFER_GROWTH_FACTOR    2048
+#define STREAMING_FLUSH_LENGTH  (1 << 16)
 #define PAGE_SIZE               4096
 
 #define ENTRY_VIRTUAL_ADDRESS   0x101078
@@ -18,6 +23,8 @@
 #define ELF_PRELUDE_LENGTH      (ELF_HEADER_LENGTH + PROGRAM_HEADER_LENGTH)
 
 #define LARGEST_INST_LENGTH     26
+#define FRAGMENT_HEADER_LENGTH  16
+#define LOOP_ALIGNMENT          64
 
 enum immxxsz
 {
@@ -29,77 +36,384 @@ enum immxxsz
 
 struct jump
 {
-	unsigned long beforeJmp;
 	unsigned long afterJmp;
+	unsigned long head;
 	unsigned long offset;
 };
 
+struct cached
+{
+	signed long   offset;
+	unsigned long stamp;
+	unsigned char reg;
+	bool          used;
+	bool          dirty;
+};
+
 struct objcode
 {
+	struct cached cache[CACHED_CELLS];
 	struct jump   *jmps;
 	unsigned char *buffer;
+	const char    *literals;
+	FILE          *sink;
+	const char    *filename;
+	size_t        flushed;
 	size_t        len;
 	size_t        cap;
 	unsigned long vrip;
 	unsigned long jmp;
+	unsigned long jmpcap;
+	unsigned long clock;
+	unsigned long flush;
+	unsigned long refill;
 	enum immxxsz  immsz;
+	enum eof      eof;
+	bool          unbounded;
+	bool          executable;
 };
 
 struct amd64inst
 {
 	unsigned char source[LARGEST_INST_LENGTH];
 	const size_t  immOffset;
+	const size_t  dispOffset;
 	const size_t  length;
 };
 
-static void init_elf_generator (struct objcode*, const unsigned long, const unsigned char);
-static void dump_object_code (struct objcode*, const char*, const unsigned int, const unsigned char);
+static void init_objcode (struct objcode*, const unsigned char, const unsigned long);
+static void init_elf_generator (struct objcode*, const unsigned char, const unsigned long, const bool);
+
+static void assemble_tokens (struct objcode*, const struct token*, const size_t);
+static unsigned char *map_object_code (struct objcode*, const size_t, const size_t, const size_t);
+static void clean_object_code (struct objcode*);
+static void dump_object_code (struct objcode*, const char*, const unsigned int, const unsigned char, const struct image*);
+static void write_elf_prelude (FILE*, const char*, const unsigned long, const unsigned long);
+
+static void assemble_batch (const struct stream*, void*);
+static void flush_object_code (struct objcode*);
+static void patch_object_code (struct objcode*, const unsigned long, const size_t, const enum immxxsz);
 
 static void write_object_code (struct objcode*, const unsigned char*, const size_t);
 static void insert_immxx_into_instruction (const unsigned long, size_t, const enum immxxsz, unsigned char*);
 
-static void emmit_amd64_inc_dec (struct objcode*, const unsigned long, const char);
+static void emmit_amd64_arith (struct objcode*, const unsigned long, const signed long, const char);
+static size_t encode_amd64_cell (unsigned char*, size_t, const unsigned char, const signed long);
 static void emmit_amd64_nxt_prv (struct objcode*, const unsigned long, const char);
 
+static struct cached *lookup_cached_cell (struct objcode*, const signed long);
+static struct cached *cache_cell (struct objcode*, const signed long, const bool);
+static void spill_cached_cells (struct objcode*);
+static void emmit_amd64_load_store (struct objcode*, const struct cached*, const bool);
+
 static void emmit_amd64_out_inp (struct objcode*, const unsigned long, const char);
 static void emmit_amd64_branches (struct objcode*, const char);
+static void emmit_amd64_nops (struct objcode*, size_t);
+static void emmit_amd64_exit (struct objcode*);
+
+static void emmit_amd64_runtime (struct objcode*);
+static void emmit_amd64_fault_handler (struct objcode*);
+static void emmit_amd64_call (struct objcode*, const unsigned long);
+static void emmit_amd64_release (struct objcode*);
+
+static void emmit_amd64_mul (struct objcode*, const unsigned long, const signed long);
+static void emmit_amd64_scan (struct objcode*, const signed long);
+static void emmit_amd64_print (struct objcode*, const char*, const unsigned long);
+
+void elf_produce (const struct stream *stream, const char *filename, const unsigned int tapesz, const unsigned char cellsz, const bool unbounded, const enum eof eof, const struct image *image)
+{
+	struct objcode obj = { .literals = stream->literals, .eof = eof, .executable = true };
+	init_elf_generator(&obj, cellsz, ENTRY_VIRTUAL_ADDRESS, unbounded);
+
+	/* a pre-evaluated program (see emu.c) first writes what it wrote back
+	 * then and jumps right to the token it stopped at, the code before that
+	 * token is still there since loops around it may come back:
+	 * <print>
+	 * jmp resume
+	 * <tokens before 'resume'>
+	 * resume:
+	 * <tokens from 'resume' on>
+	 */
+	const size_t resume = image ? image->resume : 0;
+	size_t skip = 0;
+
+	if (image)
+	{
+		if (image->outlen) { emmit_amd64_print(&obj, image->output, image->outlen); }
+
+		const unsigned char jump[] = { 0xe9, 0x00, 0x00, 0x00, 0x00 };
+		write_object_code(&obj, jump, sizeof(jump));
+		skip = obj.len;
+	}
+
+	assemble_tokens(&obj, stream->stream, resume);
+	if (image)
+	{
+		/* the jump lands with nothing cached (see 'cache_cell')
+		 */
+		spill_cached_cells(&obj);
+		insert_immxx_into_instruction(obj.len - skip, skip - 4, IMM_32, obj.buffer);
+	}
+
+	assemble_tokens(&obj, stream->stream + resume, stream->length - resume);
+	dump_object_code(&obj, filename, tapesz, cellsz, image);
+	clean_object_code(&obj);
+}
 
-void elf_produce (const struct stream *stream, const char *filename, const unsigned int tapesz, const unsigned char cellsz)
+void elf_produce_streaming (FILE *source, const char *name, const char *filename, const unsigned int tapesz, const unsigned char cellsz, const bool unbounded, const enum eof eof)
+{
+	/* code goes to the file as it is generated ('write_object_code'), only
+	 * the last bit and the open loops stay in memory. The header is written
+	 * twice, once so the code lands where it belongs and once more at the
+	 * end when the sizes are known
+	 */
+	struct objcode obj = { .filename = filename, .eof = eof, .executable = true };
+	obj.sink = fopen(filename, "wb+");
+	if (obj.sink == NULL)
+	{
+		fatal_file_ops(filename);
+	}
+
+	write_elf_prelude(obj.sink, filename, 0, 0);
+	init_elf_generator(&obj, cellsz, ENTRY_VIRTUAL_ADDRESS, unbounded);
+
+	struct stream stream = {0};
+	lexpa_lex_stream(source, name, &stream, assemble_batch, &obj);
+	free(stream.stream);
+	free(stream.where);
+
+	emmit_amd64_exit(&obj);
+	flush_object_code(&obj);
+
+	/* same as 'dump_object_code'
+	 */
+	const unsigned long tapelen = unbounded ? 0 : tapesz * cellsz;
+	if (!unbounded)
+	{
+		patch_object_code(&obj, obj.len, 3, IMM_32);
+	}
+
+	if (fseek(obj.sink, 0, SEEK_SET)) { fatal_file_ops(filename); }
+	write_elf_prelude(obj.sink, filename, obj.len, obj.len + tapelen);
+
+	if (fclose(obj.sink)) { fatal_file_ops(filename); }
+	clean_object_code(&obj);
+}
+
+void elf_jit (const struct stream *stream, const unsigned int tapesz, const unsigned char cellsz, const bool unbounded, const enum eof eof)
+{
+	struct objcode obj = { .literals = stream->literals, .eof = eof };
+	init_elf_generator(&obj, cellsz, 0, unbounded);
+	assemble_tokens(&obj, stream->stream, stream->length);
+	spill_cached_cells(&obj);
+	emmit_amd64_release(&obj);
+
+	/* ret
+	 * instead of the exit syscall from 'dump_object_code', so the program
+	 * returns to the driver
+	 */
+	const unsigned char outro[] = { 0xc3 };
+	write_object_code(&obj, outro, sizeof(outro));
+
+	/* layout: [ code (rx) | tape (rw) ], the tape starts at the first page
+	 * after the code so both can have different protections, 'lea r8' from
+	 * the prologue is patched to point there. An unbounded tape is mapped
+	 * by the program itself
+	 */
+	const size_t codesz = (obj.len + PAGE_SIZE - 1) & ~((size_t) PAGE_SIZE - 1);
+	const size_t mapsz  = codesz + (unbounded ? 0 : (size_t) tapesz * cellsz);
+
+	if (!unbounded)
+	{
+		insert_immxx_into_instruction(codesz - 7, 3, IMM_32, obj.buffer);
+	}
+	unsigned char *region = map_object_code(&obj, 0, codesz, mapsz);
+
+	/* the generated code only touches caller-saved registers (rax, rcx, rdx,
+	 * rsi, rdi and r8 to r11) and r12 to r14, which it saves (see
+	 * 'emmit_amd64_runtime'), so it can be called as a plain function
+	 */
+	void (*program) (void);
+	*(void**) &program = region;
+	program();
+
+	munmap(region, mapsz);
+	clean_object_code(&obj);
+}
+
+elf_native_t elf_jit_fragment (const struct token *tokens, const size_t length, const unsigned char cellsz)
 {
 	struct objcode obj = {0};
-	init_elf_generator(&obj, stream->nonested, cellsz);
+	init_objcode(&obj, cellsz, FRAGMENT_HEADER_LENGTH);
+
+	/* mov r8, rdi
+	 * the tape pointer comes as the first argument instead of being
+	 * rip-relative
+	 */
+	const unsigned char intro[] = { 0x49, 0x89, 0xf8 };
+	write_object_code(&obj, intro, sizeof(intro));
+	emmit_amd64_runtime(&obj);
+
+	/* whatever the fragment wrote is out by the time it returns, the
+	 * interpreter writes through stdio (see emu.c)
+	 */
+	assemble_tokens(&obj, tokens, length);
+	spill_cached_cells(&obj);
+	emmit_amd64_release(&obj);
+
+	/* mov rax, r8
+	 * ret
+	 * gives back where the pointer ended up
+	 */
+	const unsigned char outro[] = { 0x4c, 0x89, 0xc0, 0xc3 };
+	write_object_code(&obj, outro, sizeof(outro));
+
+	/* layout: [ mapping size | code ], the size is kept within the mapping
+	 * so 'elf_jit_release' does not need anything else
+	 */
+	const size_t mapsz = (FRAGMENT_HEADER_LENGTH + obj.len + PAGE_SIZE - 1) & ~((size_t) PAGE_SIZE - 1);
+	unsigned char *region = map_object_code(&obj, FRAGMENT_HEADER_LENGTH, mapsz, mapsz);
+	clean_object_code(&obj);
 
-	for (size_t i = 0; i < stream->length; i++)
+	elf_native_t fragment;
+	*(void**) &fragment = region + FRAGMENT_HEADER_LENGTH;
+	return fragment;
+}
+
+void elf_jit_release (elf_native_t fragment)
+{
+	unsigned char *region = *(unsigned char**) &fragment - FRAGMENT_HEADER_LENGTH;
+	size_t mapsz;
+
+	memcpy(&mapsz, region, sizeof(mapsz));
+	munmap(region, mapsz);
+}
+
+static unsigned char *map_object_code (struct objcode *obj, const size_t skip, const size_t codesz, const size_t mapsz)
+{
+	unsigned char *region = (unsigned char*) mmap(NULL, mapsz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (region == MAP_FAILED)
+	{
+		fatal_memory_ops("mapping memory for jit code");
+	}
+
+	/* every branch is relative, the code runs wherever it lands
+	 */
+	if (skip >= sizeof(mapsz))
+	{
+		memcpy(region, &mapsz, sizeof(mapsz));
+	}
+	memcpy(region + skip, obj->buffer, obj->len);
+
+	if (mprotect(region, codesz, PROT_READ | PROT_EXEC))
+	{
+		fatal_memory_ops("making jit code executable");
+	}
+	return region;
+}
+
+static void clean_object_code (struct objcode *obj)
+{
+	free(obj->buffer);
+	free(obj->jmps);
+}
+
+static void assemble_tokens (struct objcode *obj, const struct token *tokens, const size_t length)
+{
+	for (size_t i = 0; i < length; i++)
 	{
-		const struct token *token = &stream->stream[i];
-		const char mnemonic = token->meta.mnemonic;
+		const struct token *token = &tokens[i];
+		const char mnemonic = token->mnemonic;
 
 		switch (mnemonic)
 		{
 			case '+':
-			case '-': emmit_amd64_inc_dec(&obj, token->groupSize, mnemonic); break;
+			case '-':
+			case MNEMONIC_SET:
+			{
+				/* cells away from the pointer (see opt.c) are reached
+				 * through a displacement
+				 */
+				emmit_amd64_arith(obj, token->groupSize, token->offset, mnemonic);
+				break;
+			}
 
 			case '<':
-			case '>': emmit_amd64_nxt_prv(&obj, token->groupSize, mnemonic); break;
+			case '>': emmit_amd64_nxt_prv(obj, token->groupSize, mnemonic); break;
 
 			case ',':
-			case '.': emmit_amd64_out_inp(&obj, token->groupSize, mnemonic); break;
+			case '.': emmit_amd64_out_inp(obj, token->groupSize, mnemonic); break;
 
 			case '[':
-			case ']': emmit_amd64_branches(&obj, mnemonic); break;
+			case ']': emmit_amd64_branches(obj, mnemonic); break;
+
+			case MNEMONIC_MUL: emmit_amd64_mul(obj, token->groupSize, token->offset); break;
+			case MNEMONIC_SCAN: emmit_amd64_scan(obj, token->offset); break;
+			case MNEMONIC_PRINT: emmit_amd64_print(obj, obj->literals + token->offset, token->groupSize); break;
 		}
 	}
-
-	dump_object_code(&obj, filename, tapesz, cellsz);
 }
 
-static void init_elf_generator (struct objcode *obj, const unsigned long nonested, const unsigned char cellsz)
+static void init_objcode (struct objcode *obj, const unsigned char cellsz, const unsigned long vrip)
 {
 	obj->cap    = BUFFER_GROWTH_FACTOR;
 	obj->buffer = (unsigned char*) calloc(BUFFER_GROWTH_FACTOR, sizeof(*obj->buffer));
 
 	CHECK_POINTER(obj->buffer, "reserving space for object code");
-	obj->vrip = ENTRY_VIRTUAL_ADDRESS;
+	obj->vrip  = vrip;
+	obj->immsz = (enum immxxsz) cellsz;
+
+	/* registers cells are kept in (see 'cache_cell'), none of them is
+	 * used for anything else outside of syscalls and scans
+	 */
+	static const unsigned char regs[CACHED_CELLS] = { 9, 10, 11, 1 };
+	for (unsigned int i = 0; i < CACHED_CELLS; i++)
+	{
+		obj->cache[i].reg = regs[i];
+	}
+}
+
+static void init_elf_generator (struct objcode *obj, const unsigned char cellsz, const unsigned long vrip, const bool unbounded)
+{
+	init_objcode(obj, cellsz, vrip);
+	obj->unbounded = unbounded;
+
+	if (unbounded)
+	{
+		/* mov    eax, 9
+		 * xor    edi, edi
+		 * movabs rsi, UNBOUNDED_TAPE_LENGTH
+		 * mov    edx, PROT_READ | PROT_WRITE
+		 * mov    r10d, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE
+		 * mov    r8, -1
+		 * xor    r9d, r9d
+		 * syscall
+		 * movabs r8, UNBOUNDED_TAPE_LENGTH / 2
+		 * add    r8, rax
+		 *
+		 * the tape is reserved but nothing is committed until touched, the
+		 * pointer starts in the middle so it can go either way
+		 */
+		unsigned char intro[] =
+		{
+			0xb8, 0x09, 0x00, 0x00, 0x00,
+			0x31, 0xff,
+			0x48, 0xbe, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+			0xba, 0x03, 0x00, 0x00, 0x00,
+			0x41, 0xba, 0x22, 0x40, 0x00, 0x00,
+			0x49, 0xc7, 0xc0, 0xff, 0xff, 0xff, 0xff,
+			0x45, 0x31, 0xc9,
+			0x0f, 0x05,
+			0x49, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+			0x49, 0x01, 0xc0
+		};
+
+		insert_immxx_into_instruction(UNBOUNDED_TAPE_LENGTH,     9,  IMM_64, intro);
+		insert_immxx_into_instruction(UNBOUNDED_TAPE_LENGTH / 2, 42, IMM_64, intro);
+		write_object_code(obj, intro, sizeof(intro));
+		emmit_amd64_runtime(obj);
+		return;
+	}
 
 	const unsigned char intro[] =
 	{
@@ -111,13 +425,10 @@ static void init_elf_generator (struct objcode *obj, const unsigned long noneste
 	};
 
 	write_object_code(obj, intro, sizeof(intro));
-	obj->immsz = (enum immxxsz) cellsz;
-
-	obj->jmps = (struct jump*) calloc(nonested, sizeof(struct jump));
-	CHECK_POINTER(obj->jmps, "reserving space for branch-handling");
+	emmit_amd64_runtime(obj);
 }
 
-static void dump_object_code (struct objcode *obj, const char *filename, const unsigned int tapesz, const unsigned char cellsz)
+static void dump_object_code (struct objcode *obj, const char *filename, const unsigned int tapesz, const unsigned char cellsz, const struct image *image)
 {
 	FILE *file = fopen(filename, "wb");
 	if (file == NULL)
@@ -125,26 +436,44 @@ static void dump_object_code (struct objcode *obj, const char *filename, const u
 		fatal_file_ops(filename);
 	}
 
-	const unsigned char outro[] =
-	{
-		/* mov rax, 60
-		 * mov rdi, 0
-		 * syscall
-		 */
-		0x48, 0xc7, 0xc0, 0x3c, 0x00, 0x00, 0x00,
-		0x48, 0xc7, 0xc7, 0x00, 0x00, 0x00, 0x00,
-		0x0f, 0x05
-	};
-	write_object_code(obj, outro, sizeof(outro));
+	emmit_amd64_exit(obj);
 
 	/* We need to modify the address provided in 'init_elf_generator' function.
 	 * The compiler can define the offset since it already knows how big objcode is.
 	 *
 	 * Offset is three since at fourth byte within buffer is where the offset is defined
 	 * (see 'init_elf_generator.intro')
+	 *
+	 * The tape starts 7 bytes (the 'lea' itself) past the code, a pre-evaluated
+	 * tape is stored right there within the file and the pointer starts
+	 * wherever the program left it
+	 */
+	if (!obj->unbounded)
+	{
+		const unsigned long at = image ? (unsigned long) image->at * cellsz : 0;
+		insert_immxx_into_instruction(obj->len + at, 3, IMM_32, obj->buffer);
+	}
+
+	/* an unbounded tape is not part of the segment (see 'init_elf_generator'),
+	 * a pre-evaluated tape image is part of the file as well
 	 */
-	insert_immxx_into_instruction(obj->len, 3, IMM_32, obj->buffer);
+	const unsigned long tapelen  = obj->unbounded ? 0 : tapesz * cellsz;
+	const unsigned long imagelen = image ? 7 + image->length : 0;
+	write_elf_prelude(file, filename, obj->len + imagelen, obj->len + (image ? 7 : 0) + tapelen);
+
+	if (fwrite(obj->buffer, 1, obj->len, file) != obj->len) { fatal_file_ops(filename); }
 
+	if (image)
+	{
+		const unsigned char padding[7] = { 0 };
+		if (fwrite(padding, 1, sizeof(padding), file) != sizeof(padding))                { fatal_file_ops(filename); }
+		if (image->length && fwrite(image->tape, 1, image->length, file) != image->length) { fatal_file_ops(filename); }
+	}
+	if (fclose(file))                                       { fatal_file_ops(filename); }
+}
+
+static void write_elf_prelude (FILE *file, const char *filename, const unsigned long filesz, const unsigned long memsz)
+{
 	unsigned char elfprelude[] =
 	{
 		0x7f, 0x45, 0x4c, 0x46,
@@ -188,33 +517,70 @@ static void dump_object_code (struct objcode *obj, const char *filename, const u
 	insert_immxx_into_instruction(ENTRY_VIRTUAL_ADDRESS,      24 , IMM_64, elfprelude);
 	insert_immxx_into_instruction(P_OFFSET_PROG_HEADER_1,     72 , IMM_64, elfprelude);
 	insert_immxx_into_instruction(ENTRY_VIRTUAL_ADDRESS,      80 , IMM_64, elfprelude);
-	insert_immxx_into_instruction(obj->len,                   96 , IMM_64, elfprelude);
-	insert_immxx_into_instruction(obj->len + tapesz * cellsz, 104, IMM_64, elfprelude);
+	insert_immxx_into_instruction(filesz,                     96 , IMM_64, elfprelude);
+	insert_immxx_into_instruction(memsz,                      104, IMM_64, elfprelude);
 
 	if (fwrite(elfprelude, 1, sizeof(elfprelude), file) != ELF_PRELUDE_LENGTH)
 	{
 		fatal_file_ops(filename);
 	}
-	if (fwrite(obj->buffer, 1, obj->len, file) != obj->len) { fatal_file_ops(filename); }
-	if (fclose(file))                                       { fatal_file_ops(filename); }
 }
 
 static void write_object_code (struct objcode *obj, const unsigned char *instruction, const size_t length)
 {
-	if ((obj->len + length) >= obj->cap)
+	/* when streaming the buffer only holds the code from 'flushed' on, the
+	 * rest is already in the file
+	 */
+	if (obj->sink && (obj->len - obj->flushed + length) >= STREAMING_FLUSH_LENGTH)
+	{
+		flush_object_code(obj);
+	}
+
+	while ((obj->len - obj->flushed + length) >= obj->cap)
 	{
-		obj->cap += BUFFER_GROWTH_FACTOR;
+		obj->cap *= 2;
 		obj->buffer = (unsigned char*) realloc(obj->buffer, sizeof(*obj->buffer) * obj->cap);
 		CHECK_POINTER(obj->buffer, "reserving space for object code");
 	}
 
 	for (size_t i = 0; i < length; i++)
 	{
-		obj->buffer[obj->len++] = instruction[i];
+		obj->buffer[obj->len++ - obj->flushed] = instruction[i];
 		obj->vrip++;
 	}
 }
 
+static void assemble_batch (const struct stream *stream, void *obj)
+{
+	assemble_tokens((struct objcode*) obj, stream->stream, stream->length);
+}
+
+static void flush_object_code (struct objcode *obj)
+{
+	const size_t pending = obj->len - obj->flushed;
+	if (fwrite(obj->buffer, 1, pending, obj->sink) != pending) { fatal_file_ops(obj->filename); }
+	obj->flushed = obj->len;
+}
+
+static void patch_object_code (struct objcode *obj, const unsigned long value, const size_t at, const enum immxxsz size)
+{
+	/* a patch site may be in the file already (streaming), it is
+	 * rewritten in there and writing carries on at the end
+	 */
+	if (at >= obj->flushed)
+	{
+		insert_immxx_into_instruction(value, at - obj->flushed, size, obj->buffer);
+		return;
+	}
+
+	unsigned char bytes[IMM_64];
+	insert_immxx_into_instruction(value, 0, size, bytes);
+
+	if (fseek(obj->sink, ELF_PRELUDE_LENGTH + (long) at, SEEK_SET)) { fatal_file_ops(obj->filename); }
+	if (fwrite(bytes, 1, size, obj->sink) != (size_t) size)         { fatal_file_ops(obj->filename); }
+	if (fseek(obj->sink, 0, SEEK_END))                              { fatal_file_ops(obj->filename); }
+}
+
 static void insert_immxx_into_instruction (const unsigned long imm, size_t offset, const enum immxxsz sz, unsigned char *buff)
 {
 	for (register unsigned char i = 0; i < sz; i++)
@@ -223,306 +589,1000 @@ static void insert_immxx_into_instruction (const unsigned long imm, size_t offse
 	}
 }
 
-static void emmit_amd64_inc_dec (struct objcode *obj, const unsigned long imm, const char mnemonic)
-{	
-	static const struct amd64inst instructions[8] =
+static void emmit_amd64_arith (struct objcode *obj, const unsigned long imm, const signed long offset, const char mnemonic)
+{
+	/* works on the register cell 'offset' is cached in (see 'cache_cell'),
+	 * the shortest form doing the job:
+	 *   inc/dec reg                  adding 1 or -1 once wrapped
+	 *   add reg, imm8                sign extended (plain imm8 on bytes)
+	 *   add reg, imm16/imm32         sign extended on qwords
+	 *   movabs rax, imm64
+	 *   add reg, rax                 whatever is left
+	 * '-' adds the negated value, which are the same bits within the cell;
+	 * '=' does not need the old value: xor reg, reg / mov reg, imm32 or
+	 * imm64, only the low part of the register is ever stored
+	 */
+	const unsigned int  bits   = obj->immsz * 8;
+	const unsigned long mask   = (bits == 64) ? ~0UL : ((1UL << bits) - 1);
+	const unsigned long value  = ((mnemonic == '-') ? -imm : imm) & mask;
+	const signed long   signd  = (signed long) ((value >> (bits - 1)) ? (value | ~mask) : value);
+	const bool          setter = (mnemonic == MNEMONIC_SET);
+	const bool          qwords = (obj->immsz == IMM_64);
+
+	if (!setter && value == 0)
 	{
-		{
-			/* subb [r8], imm8
-			 * */
-			.source =
-			{
-				0x41, 0x80, 0x28, 0x00
-			},
-			.immOffset = 3,
-			.length    = 4,
-		},
-		{
+		return;
+	}
 
-			/* movw r9w, [r8]
-			 * subw r9w, imm16
-			 * movw [r8], r9w
-			 */
-			.source =
-			{
-				0x66, 0x45, 0x8b, 0x08,
-				0x66, 0x41, 0x81, 0xe9, 0x00, 0x00,
-				0x66, 0x45, 0x89, 0x08
-			},
-			.immOffset = 8,
-			.length    = 14
-		},
-		{
-			/* subd [r8], imm32
-			 */
-			.source =
-			{
-				0x41, 0x81, 0x28, 0x00, 0x00, 0x00, 0x00
-			},
-			.immOffset = 3,
-			.length = 7
-		},
-		{
-			/* movq rax, imm64
-			 * subq [r8], rax
-			 */
-			.source =
-			{
-				0x48, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-				0x49, 0x29, 0x00
-			},
-			.immOffset = 2,
-			.length = 13
-		},
+	struct cached *cell = cache_cell(obj, offset, !setter);
+	const unsigned char rm   = cell->reg & 7;
+	const unsigned char rexb = cell->reg >> 3;
+	cell->dirty = true;
+
+	unsigned char source[LARGEST_INST_LENGTH];
+	size_t length = 0;
+
+	if (setter)
+	{
+		if (value == 0)
 		{
-			/* addb [r8], imm8
-			 */
-			.source =
-			{
-				0x41, 0x80, 0x00, 0x00,
-			},
-			.immOffset = 3,
-			.length    = 4,
-		},
+			if (rexb) { source[length++] = 0x45; }
+			source[length++] = 0x31;
+			source[length++] = (unsigned char) (0xc0 | (rm << 3) | rm);
+		}
+		else if (value <= UINT32_MAX || signd < INT32_MIN || signd > INT32_MAX)
 		{
-			/* movw r9w, [r8]
-			 * addw r9w, imm16
-			 * movw [r8], r9w
-			 */
-			.source =
-			{
-				0x66, 0x45, 0x8b, 0x08,
-				0x66, 0x41, 0x81, 0xc1, 0x00, 0x00,
-				0x66, 0x45, 0x89, 0x08
-			},
-			.immOffset = 8,
-			.length    = 14
-		},
+			const enum immxxsz immlen = (value <= UINT32_MAX) ? IMM_32 : IMM_64;
+			if (rexb || immlen == IMM_64) { source[length++] = (unsigned char) (((immlen == IMM_64) ? 0x48 : 0x40) | rexb); }
+			source[length++] = (unsigned char) (0xb8 | rm);
+			insert_immxx_into_instruction(value, length, immlen, source);
+			length += immlen;
+		}
+		else
 		{
-			/* addd [r8], imm32
-			 */
-			.source =
-			{
-				0x41, 0x81, 0x00, 0x00, 0x00, 0x00, 0x00
-			},
-			.immOffset = 3,
-			.length = 7
-		},
+			source[length++] = (unsigned char) (0x48 | rexb);
+			source[length++] = 0xc7;
+			source[length++] = (unsigned char) (0xc0 | rm);
+			insert_immxx_into_instruction(value, length, IMM_32, source);
+			length += IMM_32;
+		}
+
+		write_object_code(obj, source, length);
+		return;
+	}
+
+	if (qwords && (signd < INT32_MIN || signd > INT32_MAX))
+	{
+		source[length++] = 0x48;
+		source[length++] = 0xb8;
+		insert_immxx_into_instruction(value, length, IMM_64, source);
+		length += IMM_64;
+
+		source[length++] = (unsigned char) (0x48 | rexb);
+		source[length++] = 0x01;
+		source[length++] = (unsigned char) (0xc0 | rm);
+		write_object_code(obj, source, length);
+		return;
+	}
+
+	const bool         bytes  = (obj->immsz == IMM_08);
+	const enum immxxsz widest = qwords ? IMM_32 : obj->immsz;
+
+	unsigned char opcode = bytes ? 0x80 : 0x81, reg = 0;
+	size_t        immlen = widest;
+
+	if (signd == 1 || signd == -1)         { opcode = bytes ? 0xfe : 0xff; reg = (signd == 1) ? 0 : 1; immlen = 0; }
+	else if (signd >= -128 && signd < 128) { opcode = bytes ? 0x80 : 0x83; immlen = IMM_08; }
+
+	/* rex is always there on bytes, so the low byte of r9 to r11 is picked
+	 * (cl is the same with or without it)
+	 */
+	const unsigned char rex = (unsigned char) ((qwords ? 0x48 : 0x40) | rexb);
+	if (obj->immsz == IMM_16) { source[length++] = 0x66; }
+	if (rex != 0x40 || bytes) { source[length++] = rex; }
+
+	source[length++] = opcode;
+	source[length++] = (unsigned char) (0xc0 | (reg << 3) | rm);
+
+	insert_immxx_into_instruction(value, length, (enum immxxsz) immlen, source);
+	length += immlen;
+	write_object_code(obj, source, length);
+}
+
+static size_t encode_amd64_cell (unsigned char *source, size_t at, const unsigned char reg, const signed long disp)
+{
+	/* modrm (and displacement) for [r8 + disp], rex.b is up to the caller
+	 */
+	if (disp == 0)
+	{
+		source[at++] = (unsigned char) (reg << 3);
+		return at;
+	}
+
+	if (disp >= -128 && disp < 128)
+	{
+		source[at++] = (unsigned char) (0x40 | (reg << 3));
+		source[at++] = (unsigned char) disp;
+		return at;
+	}
+
+	source[at++] = (unsigned char) (0x80 | (reg << 3));
+	insert_immxx_into_instruction((unsigned long) disp, at, IMM_32, source);
+	return at + IMM_32;
+}
+
+static struct cached *lookup_cached_cell (struct objcode *obj, const signed long offset)
+{
+	for (unsigned int i = 0; i < CACHED_CELLS; i++)
+	{
+		if (obj->cache[i].used && obj->cache[i].offset == offset) { return &obj->cache[i]; }
+	}
+	return NULL;
+}
+
+static struct cached *cache_cell (struct objcode *obj, const signed long offset, const bool load)
+{
+	/* cells are kept in registers within straight-line code so '+' and '-'
+	 * runs do not go through memory; what is cached is written back by
+	 * 'spill_cached_cells' before anything that reads the tape or joins
+	 * other code (loops, syscalls, scans), the least recently used cell
+	 * makes room when all registers are taken
+	 */
+	struct cached *cell = lookup_cached_cell(obj, offset);
+	if (cell == NULL)
+	{
+		cell = &obj->cache[0];
+		for (unsigned int i = 0; i < CACHED_CELLS && cell->used; i++)
 		{
-			/* movq rax, imm64
-			 * addq [r8], rax
-			 */
-			.source =
-			{
-				0x48, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-				0x49, 0x01, 0x00
-			},
-			.immOffset = 2,
-			.length = 13
+			if (!obj->cache[i].used || obj->cache[i].stamp < cell->stamp) { cell = &obj->cache[i]; }
 		}
+
+		if (cell->used && cell->dirty) { emmit_amd64_load_store(obj, cell, false); }
+		cell->used   = true;
+		cell->dirty  = false;
+		cell->offset = offset;
+
+		if (load) { emmit_amd64_load_store(obj, cell, true); }
+	}
+
+	cell->stamp = ++obj->clock;
+	return cell;
+}
+
+static void spill_cached_cells (struct objcode *obj)
+{
+	for (unsigned int i = 0; i < CACHED_CELLS; i++)
+	{
+		if (obj->cache[i].used && obj->cache[i].dirty) { emmit_amd64_load_store(obj, &obj->cache[i], false); }
+		obj->cache[i].used = false;
+	}
+}
+
+static void emmit_amd64_load_store (struct objcode *obj, const struct cached *cell, const bool load)
+{
+	/* movzx reg, byte/word [r8 + disp] / mov reg, [r8 + disp]
+	 * mov [r8 + disp], reg (low part)
+	 */
+	static const unsigned char opcodes[2][4][2] =
+	{
+		{ { 0x88 }, { 0x89 }, { 0x89 }, { 0x89 } },
+		{ { 0x0f, 0xb6 }, { 0x0f, 0xb7 }, { 0x8b }, { 0x8b } },
 	};
 
-	const unsigned int pick = ((mnemonic == '-') ? 0 : 4) + ((obj->immsz == 8) ? 3 : (obj->immsz >> 1));
-	struct amd64inst instruction = instructions[pick];
+	const unsigned int pick = ((obj->immsz == 8) ? 3 : (obj->immsz >> 1));
+	const size_t       oplen = (load && pick < 2) ? 2 : 1;
 
-	insert_immxx_into_instruction(imm, instruction.immOffset, obj->immsz, instruction.source);
-	write_object_code(obj, instruction.source, instruction.length);
+	unsigned char source[LARGEST_INST_LENGTH];
+	size_t length = 0;
+
+	if (obj->immsz == IMM_16 && !load) { source[length++] = 0x66; }
+	source[length++] = (unsigned char) (((obj->immsz == IMM_64) ? 0x49 : 0x41) | ((cell->reg >> 3) << 2));
+
+	memcpy(source + length, opcodes[load][pick], oplen);
+	length += oplen;
+	length = encode_amd64_cell(source, length, cell->reg & 7, cell->offset * (signed long) obj->immsz);
+	write_object_code(obj, source, length);
 }
 
 static void emmit_amd64_nxt_prv (struct objcode *obj, const unsigned long imm, const char mnemonic)
 {
-	static const struct amd64inst instructions[2] =
+	/* inc r8 / dec r8
+	 * add r8, imm8
+	 * add r8, imm32
+	 * movabs rax, imm64; add r8, rax
+	 */
+	const signed long delta = (signed long) (imm * obj->immsz) * ((mnemonic == '>') ? 1 : -1);
+	const signed long cells = delta / (signed long) obj->immsz;
+
+	/* cached cells follow the pointer, those out of reach of a disp8 from
+	 * where it lands are written back first
+	 */
+	for (unsigned int i = 0; i < CACHED_CELLS; i++)
 	{
-		/* movq rax, imm64
-		 * addq r8, rax
-		 */
-		{
-			.source =
-			{
-				0x48, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-				0x49, 0x01, 0xc0
-			},
-			.immOffset = 2,
-			.length = 13
-		},
-		/* movq rax, imm64
-		 * subq r8, rax
-		 */
+		struct cached *cell = &obj->cache[i];
+		if (!cell->used) { continue; }
+
+		const signed long disp = (cell->offset - cells) * (signed long) obj->immsz;
+		if (disp < -CACHE_WINDOW || disp > CACHE_WINDOW)
 		{
-			.source =
-			{
-				0x48, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-				0x49, 0x29, 0xc0
-			},
-			.immOffset = 2,
-			.length = 13
+			if (cell->dirty) { emmit_amd64_load_store(obj, cell, false); }
+			cell->used = false;
 		}
-	};
+		cell->offset -= cells;
+	}
 
-	const unsigned int pick = (mnemonic == '>') ? 0 : 1;
-	struct amd64inst instruction = instructions[pick];
+	unsigned char source[LARGEST_INST_LENGTH];
+	size_t length = 0;
 
-	insert_immxx_into_instruction(imm * obj->immsz, instruction.immOffset, obj->immsz, instruction.source);
-	write_object_code(obj, instruction.source, instruction.length);
+	if (delta == 1 || delta == -1)
+	{
+		const unsigned char step[] = { 0x49, 0xff, (delta == 1) ? 0xc0 : 0xc8 };
+		write_object_code(obj, step, sizeof(step));
+		return;
+	}
+
+	if (delta >= INT32_MIN && delta <= INT32_MAX)
+	{
+		const bool short8 = (delta >= -128 && delta < 128);
+
+		source[length++] = 0x49;
+		source[length++] = short8 ? 0x83 : 0x81;
+		source[length++] = 0xc0;
+		insert_immxx_into_instruction((unsigned long) delta, length, short8 ? IMM_08 : IMM_32, source);
+		length += short8 ? IMM_08 : IMM_32;
+		write_object_code(obj, source, length);
+		return;
+	}
+
+	const unsigned char add[] = { 0x49, 0x01, 0xc0 };
+	source[length++] = 0x48;
+	source[length++] = 0xb8;
+	insert_immxx_into_instruction((unsigned long) delta, length, IMM_64, source);
+	length += IMM_64;
+
+	memcpy(source + length, add, sizeof(add));
+	write_object_code(obj, source, length + sizeof(add));
 }
 
 static void emmit_amd64_out_inp (struct objcode *obj, const unsigned long times, const char mnemonic)
 {
-	static const struct amd64inst instructions[2] =
+	if (mnemonic == '.')
 	{
-
-		/* mov rax, 1
-		 * mov rdi, 1
-		 * mov rsi, r8
-		 * mov rdx, 1
-		 * syscall
+		/* the low byte of the cell goes into the output buffer (see
+		 * 'emmit_amd64_runtime'), which is flushed once full:
+		 * movzx eax, byte [r8]         ; not when the cell is cached
+		 * mov [rsp + r12], al          ; or the cached register
+		 * inc r12d
+		 * cmp r12d, OUTPUT_BUFFER_LENGTH
+		 * jne over
+		 * call flush
+		 * over:
 		 */
+		const struct cached *cell = lookup_cached_cell(obj, 0);
+		const unsigned char reg   = cell ? cell->reg : 0;
+
+		if (cell == NULL)
 		{
-			.source =
-			{
-				0x48, 0xc7, 0xc0, 0x01, 0x00, 0x00, 0x00,
-				0x48, 0xc7, 0xc7, 0x01, 0x00, 0x00, 0x00,
-				0x4c, 0x89, 0xc6,            
-				0x48, 0xc7, 0xc2, 0x01, 0x00, 0x00, 0x00,
-				0x0f, 0x05,
-			},
-			.immOffset = 0,
-			.length = LARGEST_INST_LENGTH
-		},
-		/* mov rax, 0
-		 * mov rdi, 0
-		 * mov rsi, r8
-		 * mov rdx, 1
-		 * syscall
-		 */
+			const unsigned char load[] = { 0x41, 0x0f, 0xb6, 0x00 };
+			write_object_code(obj, load, sizeof(load));
+		}
+
+		unsigned char append[] =
 		{
-			.source =
-			{
-				0x48, 0xc7, 0xc0, 0x00, 0x00, 0x00, 0x00,
-				0x48, 0xc7, 0xc7, 0x00, 0x00, 0x00, 0x00,
-				0x4c, 0x89, 0xc6,            
-				0x48, 0xc7, 0xc2, 0x01, 0x00, 0x00, 0x00,
-				0x0f, 0x05,
-			},
-			.immOffset = 0,
-			.length = LARGEST_INST_LENGTH
+			(unsigned char) (0x42 | ((reg >> 3) << 2)), 0x88, (unsigned char) (((reg & 7) << 3) | 0x04), 0x24,
+			0x41, 0xff, 0xc4,
+			0x41, 0x81, 0xfc, 0x00, 0x00, 0x00, 0x00,
+			0x75, 0x05
+		};
+		insert_immxx_into_instruction(OUTPUT_BUFFER_LENGTH, 10, IMM_32, append);
+
+		for (unsigned long i = 0; i < times; i++)
+		{
+			write_object_code(obj, append, sizeof(append));
+			emmit_amd64_call(obj, obj->flush);
 		}
+		return;
+	}
+
+	/* the next byte comes from the input buffer (see 'emmit_amd64_runtime')
+	 * and only an empty one goes through 'refill', which also says what is
+	 * left on EOF; what was written so far goes out before waiting on input:
+	 * cmp r13, r14
+	 * je slow
+	 * movzx eax, byte [r13]
+	 * inc r13
+	 * jmp store
+	 * slow:
+	 * call flush
+	 * call refill
+	 * store:
+	 * mov [r8], al/ax/eax/rax
+	 */
+	static const unsigned char fast[] =
+	{
+		0x4d, 0x39, 0xf5,
+		0x74, 0x0a,
+		0x41, 0x0f, 0xb6, 0x45, 0x00,
+		0x49, 0xff, 0xc5,
+		0xeb, 0x0a
+	};
+
+	static const struct amd64inst stores[] =
+	{
+		{ .source = { 0x41, 0x88, 0x00 },       .length = 3 },
+		{ .source = { 0x66, 0x41, 0x89, 0x00 }, .length = 4 },
+		{ .source = { 0x41, 0x89, 0x00 },       .length = 3 },
+		{ .source = { 0x49, 0x89, 0x00 },       .length = 3 },
 	};
 
-	const unsigned int pick = (mnemonic == '.') ? 0 : 1;
-	struct amd64inst instruction = instructions[pick];
+	/* the cell is written in memory, a cached copy would be stale (and
+	 * has to be there for EOF to leave it unchanged); other cells stay
+	 * cached since 'refill' keeps rcx and r11
+	 */
+	struct cached *cell = lookup_cached_cell(obj, 0);
+	if (cell)
+	{
+		if (cell->dirty) { emmit_amd64_load_store(obj, cell, false); }
+		cell->used = false;
+	}
 
+	const struct amd64inst *store = &stores[obj->immsz == IMM_08 ? 0 : obj->immsz == IMM_16 ? 1 : obj->immsz == IMM_32 ? 2 : 3];
 	for (unsigned long i = 0; i < times; i++)
 	{
-		write_object_code(obj, instruction.source, instruction.length);
+		write_object_code(obj, fast, sizeof(fast));
+		emmit_amd64_call(obj, obj->flush);
+		emmit_amd64_call(obj, obj->refill);
+		write_object_code(obj, store->source, store->length);
 	}
 }
 
+static void emmit_amd64_exit (struct objcode *obj)
+{
+	emmit_amd64_call(obj, obj->flush);
+	const unsigned char outro[] =
+	{
+		/* mov rax, 60
+		 * mov rdi, 0
+		 * syscall
+		 */
+		0x48, 0xc7, 0xc0, 0x3c, 0x00, 0x00, 0x00,
+		0x48, 0xc7, 0xc7, 0x00, 0x00, 0x00, 0x00,
+		0x0f, 0x05
+	};
+	write_object_code(obj, outro, sizeof(outro));
+}
+
+static void emmit_amd64_runtime (struct objcode *obj)
+{
+	/* '.' writes into a buffer on the stack instead of doing a syscall per
+	 * byte, r12 holds how much of it is taken; the routine writing it out
+	 * sits right here and is called ('emmit_amd64_call') once the buffer
+	 * is full, before reading and at the end. ',' reads from a second
+	 * buffer right above it, r13 is the next byte and r14 its end:
+	 * push r12
+	 * push r13
+	 * push r14
+	 * sub rsp, OUTPUT_BUFFER_LENGTH + INPUT_BUFFER_LENGTH
+	 * xor r12d, r12d
+	 * xor r13d, r13d
+	 * xor r14d, r14d
+	 * jmp over
+	 * flush:
+	 * test r12d, r12d
+	 * jz done
+	 * push rcx                     ; cached cells, see 'cache_cell'
+	 * push r11
+	 * mov eax, 1
+	 * mov edi, 1
+	 * lea rsi, [rsp + 24]          ; past both pushes and the return address
+	 * mov edx, r12d
+	 * syscall
+	 * pop r11
+	 * pop rcx
+	 * xor r12d, r12d
+	 * done:
+	 * ret
+	 */
+	unsigned char runtime[] =
+	{
+		0x41, 0x54,
+		0x41, 0x55,
+		0x41, 0x56,
+		0x48, 0x81, 0xec, 0x00, 0x00, 0x00, 0x00,
+		0x45, 0x31, 0xe4,
+		0x45, 0x31, 0xed,
+		0x45, 0x31, 0xf6,
+		0xeb, 0x00,
+		0x45, 0x85, 0xe4,
+		0x74, 0x1d,
+		0x51,
+		0x41, 0x53,
+		0xb8, 0x01, 0x00, 0x00, 0x00,
+		0xbf, 0x01, 0x00, 0x00, 0x00,
+		0x48, 0x8d, 0x74, 0x24, 0x18,
+		0x44, 0x89, 0xe2,
+		0x0f, 0x05,
+		0x41, 0x5b,
+		0x59,
+		0x45, 0x31, 0xe4,
+		0xc3
+	};
+
+	/* refill:
+	 * push rcx
+	 * push r11
+	 * xor eax, eax
+	 * xor edi, edi
+	 * lea rsi, [rsp + 24 + OUTPUT_BUFFER_LENGTH]
+	 * mov edx, INPUT_BUFFER_LENGTH
+	 * syscall
+	 * pop r11
+	 * pop rcx
+	 * test rax, rax
+	 * jle eof
+	 * lea r13, [rsp + 8 + OUTPUT_BUFFER_LENGTH]
+	 * lea r14, [r13 + rax]
+	 * movzx eax, byte [r13]
+	 * inc r13
+	 * ret
+	 * eof:
+	 * <what -e says goes into rax>
+	 * ret
+	 * over:
+	 */
+	unsigned char refill[] =
+	{
+		0x51,
+		0x41, 0x53,
+		0x31, 0xc0,
+		0x31, 0xff,
+		0x48, 0x8d, 0xb4, 0x24, 0x00, 0x00, 0x00, 0x00,
+		0xba, 0x00, 0x00, 0x00, 0x00,
+		0x0f, 0x05,
+		0x41, 0x5b,
+		0x59,
+		0x48, 0x85, 0xc0,
+		0x7e, 0x16,
+		0x4c, 0x8d, 0xac, 0x24, 0x00, 0x00, 0x00, 0x00,
+		0x4d, 0x8d, 0x74, 0x05, 0x00,
+		0x41, 0x0f, 0xb6, 0x45, 0x00,
+		0x49, 0xff, 0xc5,
+		0xc3
+	};
+
+	/* the cell as it is (unchanged), zero or all ones
+	 */
+	static const struct amd64inst eofs[] =
+	{
+		{ .source = { 0x41, 0x0f, 0xb6, 0x00, 0xc3 }, .length = 5 },
+		{ .source = { 0x41, 0x0f, 0xb7, 0x00, 0xc3 }, .length = 5 },
+		{ .source = { 0x41, 0x8b, 0x00, 0xc3 },       .length = 4 },
+		{ .source = { 0x49, 0x8b, 0x00, 0xc3 },       .length = 4 },
+		{ .source = { 0x31, 0xc0, 0xc3 },             .length = 3 },
+		{ .source = { 0x48, 0x83, 0xc8, 0xff, 0xc3 }, .length = 5 },
+	};
+
+	const struct amd64inst *eof = (obj->eof == EOF_ZERO)      ? &eofs[4]
+	                            : (obj->eof == EOF_MINUS_ONE) ? &eofs[5]
+	                            : &eofs[obj->immsz == IMM_08 ? 0 : obj->immsz == IMM_16 ? 1 : obj->immsz == IMM_32 ? 2 : 3];
+
+	insert_immxx_into_instruction(OUTPUT_BUFFER_LENGTH + INPUT_BUFFER_LENGTH, 9, IMM_32, runtime);
+	insert_immxx_into_instruction(sizeof(runtime) - 24 + sizeof(refill) + eof->length, 23, IMM_08, runtime);
+	insert_immxx_into_instruction(24 + OUTPUT_BUFFER_LENGTH, 11, IMM_32, refill);
+	insert_immxx_into_instruction(INPUT_BUFFER_LENGTH, 16, IMM_32, refill);
+	insert_immxx_into_instruction(8 + OUTPUT_BUFFER_LENGTH, 34, IMM_32, refill);
+	write_object_code(obj, runtime, 24);
+
+	obj->flush = obj->vrip;
+	write_object_code(obj, runtime + 24, sizeof(runtime) - 24);
+
+	obj->refill = obj->vrip;
+	write_object_code(obj, refill, sizeof(refill));
+	write_object_code(obj, eof->source, eof->length);
+
+	if (obj->executable) { emmit_amd64_fault_handler(obj); }
+}
+
+static void emmit_amd64_fault_handler (struct objcode *obj)
+{
+	/* a program running off the tape dies on SIGSEGV (or SIGBUS) with its
+	 * output still buffered, this handler writes it out and raises the
+	 * signal again, which takes the default action by then (SA_RESETHAND,
+	 * SA_NODEFER). It starts with the registers of the faulting code, but
+	 * rdi, rsi, rdx and rax: r12 and rbp (the buffer, set here) among them.
+	 * Only for executables, the JIT leaves bc's signals alone:
+	 * jmp install
+	 * fault:
+	 * mov ebx, edi                 ; the signal
+	 * mov rsp, rbp                 ; 'flush' finds the buffer from rsp
+	 * call flush
+	 * mov eax, 39                  ; getpid
+	 * syscall
+	 * mov edi, eax
+	 * mov esi, ebx
+	 * mov eax, 62                  ; kill
+	 * syscall
+	 * restore:                     ; never reached, x86-64 wants one though
+	 * mov eax, 15                  ; rt_sigreturn
+	 * syscall
+	 * install:
+	 * mov rbp, rsp
+	 * push 0                       ; sa_mask
+	 * lea rax, [rip + restore]
+	 * push rax                     ; sa_restorer
+	 * mov eax, SA_RESTORER | SA_RESETHAND | SA_NODEFER
+	 * push rax                     ; sa_flags
+	 * lea rax, [rip + fault]
+	 * push rax                     ; sa_handler
+	 * mov eax, 13                  ; rt_sigaction
+	 * mov edi, 11                  ; SIGSEGV
+	 * mov rsi, rsp
+	 * xor edx, edx
+	 * mov r10d, 8                  ; sizeof(sigset_t)
+	 * syscall
+	 * mov eax, 13
+	 * mov edi, 7                   ; SIGBUS
+	 * syscall
+	 * add rsp, 32
+	 */
+	const unsigned char enter[] = { 0xeb, 0x23, 0x89, 0xfb, 0x48, 0x89, 0xec };
+	const unsigned char leave[] =
+	{
+		0xb8, 0x27, 0x00, 0x00, 0x00,
+		0x0f, 0x05,
+		0x89, 0xc7,
+		0x89, 0xde,
+		0xb8, 0x3e, 0x00, 0x00, 0x00,
+		0x0f, 0x05,
+		0xb8, 0x0f, 0x00, 0x00, 0x00,
+		0x0f, 0x05
+	};
+	unsigned char install[] =
+	{
+		0x48, 0x89, 0xe5,
+		0x6a, 0x00,
+		0x48, 0x8d, 0x05, 0x00, 0x00, 0x00, 0x00,
+		0x50,
+		0xb8, 0x00, 0x00, 0x00, 0xc4,
+		0x50,
+		0x48, 0x8d, 0x05, 0x00, 0x00, 0x00, 0x00,
+		0x50,
+		0xb8, 0x0d, 0x00, 0x00, 0x00,
+		0xbf, 0x0b, 0x00, 0x00, 0x00,
+		0x48, 0x89, 0xe6,
+		0x31, 0xd2,
+		0x41, 0xba, 0x08, 0x00, 0x00, 0x00,
+		0x0f, 0x05,
+		0xb8, 0x0d, 0x00, 0x00, 0x00,
+		0xbf, 0x07, 0x00, 0x00, 0x00,
+		0x0f, 0x05,
+		0x48, 0x83, 0xc4, 0x20
+	};
+
+	const unsigned long fault = obj->vrip + 2;
+	write_object_code(obj, enter, sizeof(enter));
+	emmit_amd64_call(obj, obj->flush);
+	write_object_code(obj, leave, sizeof(leave));
+
+	const unsigned long restore = obj->vrip - 7;
+	insert_immxx_into_instruction(restore - (obj->vrip + 12), 8,  IMM_32, install);
+	insert_immxx_into_instruction(fault   - (obj->vrip + 26), 22, IMM_32, install);
+	write_object_code(obj, install, sizeof(install));
+}
+
+static void emmit_amd64_call (struct objcode *obj, const unsigned long routine)
+{
+	/* call <routine>
+	 * one of the ones from 'emmit_amd64_runtime'
+	 */
+	unsigned char call[] = { 0xe8, 0x00, 0x00, 0x00, 0x00 };
+	insert_immxx_into_instruction(routine - (obj->vrip + sizeof(call)), 1, IMM_32, call);
+	write_object_code(obj, call, sizeof(call));
+}
+
+static void emmit_amd64_release (struct objcode *obj)
+{
+	/* call flush
+	 * add rsp, OUTPUT_BUFFER_LENGTH + INPUT_BUFFER_LENGTH
+	 * pop r14
+	 * pop r13
+	 * pop r12
+	 * for code returning to its caller instead of exiting
+	 */
+	unsigned char release[] = { 0x48, 0x81, 0xc4, 0x00, 0x00, 0x00, 0x00, 0x41, 0x5e, 0x41, 0x5d, 0x41, 0x5c };
+	insert_immxx_into_instruction(OUTPUT_BUFFER_LENGTH + INPUT_BUFFER_LENGTH, 3, IMM_32, release);
+
+	emmit_amd64_call(obj, obj->flush);
+	write_object_code(obj, release, sizeof(release));
+}
+
 static void emmit_amd64_branches (struct objcode *obj, const char mnemonic)
 {
+	/* loops are turned upside down, the test is done at the bottom and
+	 * the one at the top only guards the way in; the body (the head) is
+	 * aligned to a cache line, the padding runs once per entry at most:
+	 * cmp [r8], 0
+	 * je  <after ']'>      ; rel32, patched by ']'
+	 * <nops>
+	 * head:
+	 * <body>
+	 * cmp [r8], 0
+	 * jne head             ; rel8 or rel32, whichever reaches
+	 * both ends join other code so cached cells are written back first,
+	 * the current one is tested right on its register (test reg, reg)
+	 */
+	static const unsigned char tests[4][5] =
+	{
+		{ 0x41, 0x80, 0x38, 0x00 },
+		{ 0x66, 0x41, 0x83, 0x38, 0x00 },
+		{ 0x41, 0x83, 0x38, 0x00 },
+		{ 0x49, 0x83, 0x38, 0x00 },
+	};
+
+	const unsigned int pick    = ((obj->immsz == 8) ? 3 : (obj->immsz >> 1));
+	const size_t       testlen = (pick == 1) ? 5 : 4;
+	const struct cached *cell  = lookup_cached_cell(obj, 0);
+
+	if (cell)
+	{
+		const unsigned char reg = cell->reg;
+		unsigned char source[LARGEST_INST_LENGTH];
+		size_t length = 0;
+
+		if (obj->immsz == IMM_16) { source[length++] = 0x66; }
+		source[length++] = (unsigned char) (((obj->immsz == IMM_64) ? 0x48 : 0x40) | ((reg >> 3) << 2) | (reg >> 3));
+		source[length++] = (obj->immsz == IMM_08) ? 0x84 : 0x85;
+		source[length++] = (unsigned char) (0xc0 | ((reg & 7) << 3) | (reg & 7));
+
+		spill_cached_cells(obj);
+		write_object_code(obj, source, length);
+	}
+	else
+	{
+		spill_cached_cells(obj);
+		write_object_code(obj, tests[pick], testlen);
+	}
+
 	if (mnemonic == ']')
 	{
-		struct amd64inst str8jmp =
+		struct jump *last = &obj->jmps[--obj->jmp];
+
+		const signed long back = (signed long) last->head - (signed long) (obj->vrip + 2);
+		unsigned char jne[6] = { 0x75 };
+		size_t jnelen = 2;
+
+		if (back >= -128)
 		{
-			/* movq rax, <address>
-			 * jmp rax
-			 */
-			.source =
-			{
-				0x48, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-				0xff, 0xe0
-			},
-			.immOffset = 2,
-			.length = 12
-		};
+			jne[1] = (unsigned char) back;
+		}
+		else
+		{
+			jne[0] = 0x0f;
+			jne[1] = 0x85;
+			insert_immxx_into_instruction((unsigned long) (back - 4), 2, IMM_32, jne);
+			jnelen = 6;
+		}
 
-		struct jump *last = &obj->jmps[--obj->jmp];
-		const unsigned int relative = (obj->vrip + str8jmp.length) - last->afterJmp;
+		write_object_code(obj, jne, jnelen);
+		patch_object_code(obj, obj->vrip - last->afterJmp, last->offset, IMM_32);
+		return;
+	}
+
+	/* as deep as the source goes, doubling keeps deep nests linear
+	 */
+	if (obj->jmp == obj->jmpcap)
+	{
+		obj->jmpcap = obj->jmpcap ? 2 * obj->jmpcap : OPENLOOP_GROWTH_FACTOR;
+		obj->jmps   = (struct jump*) realloc(obj->jmps, sizeof(struct jump) * obj->jmpcap);
+		CHECK_POINTER(obj->jmps, "reserving space for branch-handling");
+	}
+
+	const unsigned char je[] = { 0x0f, 0x84, 0x00, 0x00, 0x00, 0x00 };
+	struct jump *jmp = &obj->jmps[obj->jmp++];
+
+	jmp->offset = obj->len + 2;
+	write_object_code(obj, je, sizeof(je));
+	jmp->afterJmp = obj->vrip;
+
+	emmit_amd64_nops(obj, (LOOP_ALIGNMENT - obj->vrip % LOOP_ALIGNMENT) % LOOP_ALIGNMENT);
+	jmp->head = obj->vrip;
+}
+
+static void emmit_amd64_nops (struct objcode *obj, size_t length)
+{
+	/* the recommended multi-byte nops, longest first
+	 */
+	static const unsigned char nops[9][9] =
+	{
+		{ 0x90 },
+		{ 0x66, 0x90 },
+		{ 0x0f, 0x1f, 0x00 },
+		{ 0x0f, 0x1f, 0x40, 0x00 },
+		{ 0x0f, 0x1f, 0x44, 0x00, 0x00 },
+		{ 0x66, 0x0f, 0x1f, 0x44, 0x00, 0x00 },
+		{ 0x0f, 0x1f, 0x80, 0x00, 0x00, 0x00, 0x00 },
+		{ 0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 },
+		{ 0x66, 0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 },
+	};
+
+	while (length)
+	{
+		const size_t chunk = (length > 9) ? 9 : length;
+		write_object_code(obj, nops[chunk - 1], chunk);
+		length -= chunk;
+	}
+}
+
+static void emmit_amd64_mul (struct objcode *obj, const unsigned long factor, const signed long offset)
+{
+	/* below 64 bits the product is computed on eax, only the low part
+	 * gets stored:
+	 * movzx eax, [r8]              ; mov eax / rax on wider cells
+	 * imul eax, eax, imm8/imm32    ; none when the factor is 1
+	 * add [r8 + disp], al/ax/eax
+	 * on qwords a factor beyond imm32 goes through 'movabs rdx; imul rax, rdx';
+	 * cached cells (see 'cache_cell') are used right from their registers
+	 */
+	static const unsigned char loads[4][4] =
+	{
+		{ 0x41, 0x0f, 0xb6, 0x00 },
+		{ 0x41, 0x0f, 0xb7, 0x00 },
+		{ 0x41, 0x8b, 0x00 },
+		{ 0x49, 0x8b, 0x00 },
+	};
+
+	const unsigned int  pick   = ((obj->immsz == 8) ? 3 : (obj->immsz >> 1));
+	const unsigned int  bits   = obj->immsz * 8;
+	const unsigned long mask   = (bits == 64) ? ~0UL : ((1UL << bits) - 1);
+	const unsigned long value  = factor & mask;
+	const signed long   signd  = (signed long) ((value >> (bits - 1)) ? (value | ~mask) : value);
+	const bool          qwords = (obj->immsz == IMM_64);
+
+	const struct cached *from = lookup_cached_cell(obj, 0);
+	struct cached       *to   = lookup_cached_cell(obj, offset);
+
+	unsigned char source[LARGEST_INST_LENGTH];
+	size_t length = 0;
 
-		/* patches:
-		 * 1. relative address when '[' was defined
-		 * 2. absolute address where to jump everytime ']' is found
+	if (from)
+	{
+		/* mov eax, reg / mov rax, reg
 		 */
-		insert_immxx_into_instruction(relative, last->offset, IMM_32, obj->buffer);
-		insert_immxx_into_instruction(last->beforeJmp, str8jmp.immOffset, IMM_32, str8jmp.source);
+		const unsigned char rex = (unsigned char) ((qwords ? 0x48 : 0x40) | ((from->reg >> 3) << 2));
+		if (rex != 0x40) { source[length++] = rex; }
+		source[length++] = 0x89;
+		source[length++] = (unsigned char) (0xc0 | ((from->reg & 7) << 3));
+	}
+	else
+	{
+		length = (pick < 2) ? 4 : 3;
+		memcpy(source, loads[pick], length);
+	}
 
-		write_object_code(obj, str8jmp.source, str8jmp.length);
-		return;
+	if (qwords && (signd < INT32_MIN || signd > INT32_MAX))
+	{
+		const unsigned char imul[] = { 0x48, 0x0f, 0xaf, 0xc2 };
+		source[length++] = 0x48;
+		source[length++] = 0xba;
+		insert_immxx_into_instruction(value, length, IMM_64, source);
+		length += IMM_64;
+
+		memcpy(source + length, imul, sizeof(imul));
+		length += sizeof(imul);
+	}
+	else if (signd != 1)
+	{
+		const bool short8 = (signd >= -128 && signd < 128);
+		if (qwords) { source[length++] = 0x48; }
+		source[length++] = short8 ? 0x6b : 0x69;
+		source[length++] = 0xc0;
+		insert_immxx_into_instruction((unsigned long) signd, length, short8 ? IMM_08 : IMM_32, source);
+		length += short8 ? IMM_08 : IMM_32;
 	}
 
-	static const struct amd64inst instructions[4] =
+	if (obj->immsz == IMM_16) { source[length++] = 0x66; }
+	if (to)
+	{
+		/* add reg, al/ax/eax/rax
+		 */
+		source[length++] = (unsigned char) ((qwords ? 0x48 : 0x40) | (to->reg >> 3));
+		source[length++] = (obj->immsz == IMM_08) ? 0x00 : 0x01;
+		source[length++] = (unsigned char) (0xc0 | (to->reg & 7));
+		to->dirty = true;
+	}
+	else
+	{
+		source[length++] = qwords ? 0x49 : 0x41;
+		source[length++] = (obj->immsz == IMM_08) ? 0x00 : 0x01;
+		length = encode_amd64_cell(source, length, 0, offset * (signed long) obj->immsz);
+	}
+
+	write_object_code(obj, source, length);
+}
+
+static void emmit_amd64_scan (struct objcode *obj, const signed long stride)
+{
+	/* byte cells walked one at a time are searched 16 at a time: loads are
+	 * aligned so they never cross into a page the program would not touch,
+	 * the bits of the first block which lay behind (or ahead of, going
+	 * backwards) the pointer are masked off. Any other stride or width
+	 * steps cell by cell
+	 */
+	/* movl ecx, r8d
+	 * andl ecx, 15
+	 * movq rax, r8
+	 * andq rax, -16
+	 * pxor xmm1, xmm1
+	 * movdqa xmm0, [rax]
+	 * pcmpeqb xmm0, xmm1
+	 * pmovmskb edx, xmm0
+	 * movl esi, -1
+	 * shll esi, cl
+	 * andl edx, esi
+	 * jnz found
+	 * loop:
+	 * addq rax, 16
+	 * movdqa xmm0, [rax]
+	 * pcmpeqb xmm0, xmm1
+	 * pmovmskb edx, xmm0
+	 * testl edx, edx
+	 * jz loop
+	 * found:
+	 * bsfl edx, edx
+	 * leaq r8, [rax + rdx]
+	 */
+	static const unsigned char forward[] =
+	{
+		0x44, 0x89, 0xc1, 0x83, 0xe1, 0x0f,
+		0x4c, 0x89, 0xc0, 0x48, 0x83, 0xe0, 0xf0,
+		0x66, 0x0f, 0xef, 0xc9,
+		0x66, 0x0f, 0x6f, 0x00, 0x66, 0x0f, 0x74, 0xc1, 0x66, 0x0f, 0xd7, 0xd0,
+		0xbe, 0xff, 0xff, 0xff, 0xff, 0xd3, 0xe6, 0x21, 0xf2,
+		0x75, 0x14,
+		0x48, 0x83, 0xc0, 0x10,
+		0x66, 0x0f, 0x6f, 0x00, 0x66, 0x0f, 0x74, 0xc1, 0x66, 0x0f, 0xd7, 0xd0,
+		0x85, 0xd2, 0x74, 0xec,
+		0x0f, 0xbc, 0xd2, 0x4c, 0x8d, 0x04, 0x10
+	};
+
+	/* same thing backwards, the mask keeps bits 0..cl and the last zero
+	 * of a block is the one wanted:
+	 * movl esi, 2; shll esi, cl; decl esi (mask)
+	 * subq rax, 16 (loop)
+	 * bsrl edx, edx (found)
+	 */
+	static const unsigned char backward[] =
+	{
+		0x44, 0x89, 0xc1, 0x83, 0xe1, 0x0f,
+		0x4c, 0x89, 0xc0, 0x48, 0x83, 0xe0, 0xf0,
+		0x66, 0x0f, 0xef, 0xc9,
+		0x66, 0x0f, 0x6f, 0x00, 0x66, 0x0f, 0x74, 0xc1, 0x66, 0x0f, 0xd7, 0xd0,
+		0xbe, 0x02, 0x00, 0x00, 0x00, 0xd3, 0xe6, 0xff, 0xce, 0x21, 0xf2,
+		0x75, 0x14,
+		0x48, 0x83, 0xe8, 0x10,
+		0x66, 0x0f, 0x6f, 0x00, 0x66, 0x0f, 0x74, 0xc1, 0x66, 0x0f, 0xd7, 0xd0,
+		0x85, 0xd2, 0x74, 0xec,
+		0x0f, 0xbd, 0xd2, 0x4c, 0x8d, 0x04, 0x10
+	};
+
+	static const struct amd64inst stepping[4] =
 	{
 		{
-			/* movb al, [r8]
-			 * cmpb al, 0
-			 * je   <address>
+			/* loop:
+			 * cmpb [r8], 0
+			 * je done
+			 * addq r8, imm32
+			 * jmp loop
+			 * done:
 			 */
 			.source =
 			{
-				0x41, 0x8a, 0x00,
-				0x3c, 0x00,
-				0x0f, 0x84, 0x00, 0x00, 0x00, 0x00
+				0x41, 0x80, 0x38, 0x00,
+				0x74, 0x09,
+				0x49, 0x81, 0xc0, 0x00, 0x00, 0x00, 0x00,
+				0xeb, 0xf1
 			},
-			.immOffset = 7,
-			.length = 11
+			.immOffset = 9,
+			.length    = 15
 		},
 		{
-			/* movw ax, [r8]
-			 * cmpw ax, 0
-			 * je   <address>
+			/* cmpw [r8], 0
 			 */
 			.source =
 			{
-				0x66, 0x41, 0x8b, 0x00,
-				0x66, 0x3d, 0x00, 0x00,
-				0x0f, 0x84, 0x00, 0x00, 0x00, 0x00
+				0x66, 0x41, 0x83, 0x38, 0x00,
+				0x74, 0x09,
+				0x49, 0x81, 0xc0, 0x00, 0x00, 0x00, 0x00,
+				0xeb, 0xf0
 			},
 			.immOffset = 10,
-			.length = 14
+			.length    = 16
 		},
 		{
-			/* movl eax, [r8]
-			 * cmpl eax, 0
-			 * je   <address>
+			/* cmpd [r8], 0
 			 */
 			.source =
 			{
-				0x41, 0x8b, 0x00,
-				0x3d, 0x00, 0x00, 0x00, 0x00,
-				0x0f, 0x84, 0x00, 0x00, 0x00, 0x00
+				0x41, 0x83, 0x38, 0x00,
+				0x74, 0x09,
+				0x49, 0x81, 0xc0, 0x00, 0x00, 0x00, 0x00,
+				0xeb, 0xf1
 			},
-			.immOffset = 10,
-			.length = 14
+			.immOffset = 9,
+			.length    = 15
 		},
 		{
-			/* movq rax, [r8]
-			 * cmpq rax, 0
-			 * je   <address>
+			/* cmpq [r8], 0
 			 */
 			.source =
 			{
-				0x49, 0x8b, 0x00,
-				0x48, 0x83, 0xf8, 0x00,
-				0x0f, 0x84, 0x00, 0x00, 0x00, 0x00
+				0x49, 0x83, 0x38, 0x00,
+				0x74, 0x09,
+				0x49, 0x81, 0xc0, 0x00, 0x00, 0x00, 0x00,
+				0xeb, 0xf1
 			},
 			.immOffset = 9,
-			.length = 13
-		},
+			.length    = 15
+		}
 	};
 
-	const unsigned int pick = ((obj->immsz == 8) ? 3 : (obj->immsz >> 1));
-	struct amd64inst instruction =  instructions[pick];
+	spill_cached_cells(obj);
+	if (obj->immsz == IMM_08 && (stride == 1 || stride == -1))
+	{
+		if (stride == 1) { write_object_code(obj, forward,  sizeof(forward));  }
+		else             { write_object_code(obj, backward, sizeof(backward)); }
+		return;
+	}
 
-	struct jump *jmp = &obj->jmps[obj->jmp++];
-	jmp->offset      = obj->len + instruction.immOffset;
-	/* address before writing the instruction.source, this is needed since this is the absolute
-	 * address where ] will jump
-	 */
-	jmp->beforeJmp   = obj->vrip;
+	const unsigned int pick = ((obj->immsz == 8) ? 3 : (obj->immsz >> 1));
+	struct amd64inst instruction = stepping[pick];
 
+	insert_immxx_into_instruction((unsigned long) (stride * obj->immsz), instruction.immOffset, IMM_32, instruction.source);
 	write_object_code(obj, instruction.source, instruction.length);
-	/* address after writing the instruction.source, this is needed since it's used to calculate
-	 * the relative address for '[' jumps
+}
+
+static void emmit_amd64_print (struct objcode *obj, const char *literal, const unsigned long length)
+{
+	/* the bytes live right within the code, jumped over:
+	 * jmp over
+	 * <literal>
+	 * over:
+	 * lea rsi, [rip - (length + 7)]
+	 * mov eax, 1
+	 * mov edi, 1
+	 * mov edx, length
+	 * syscall
+	 * the syscall takes rcx and r11 so cached cells go back first, what
+	 * '.' buffered goes out before
 	 */
-	jmp->afterJmp = obj->vrip;
+	spill_cached_cells(obj);
+	emmit_amd64_call(obj, obj->flush);
+	struct amd64inst jump =
+	{
+		.source    = { 0xe9, 0x00, 0x00, 0x00, 0x00 },
+		.immOffset = 1,
+		.length    = 5
+	};
+	struct amd64inst write =
+	{
+		.source =
+		{
+			0x48, 0x8d, 0x35, 0x00, 0x00, 0x00, 0x00,
+			0xb8, 0x01, 0x00, 0x00, 0x00,
+			0xbf, 0x01, 0x00, 0x00, 0x00,
+			0xba, 0x00, 0x00, 0x00, 0x00,
+			0x0f, 0x05
+		},
+		.dispOffset = 3,
+		.immOffset  = 18,
+		.length     = 24
+	};
+
+	insert_immxx_into_instruction(length, jump.immOffset, IMM_32, jump.source);
+	write_object_code(obj, jump.source, jump.length);
+	write_object_code(obj, (const unsigned char*) literal, length);
+
+	insert_immxx_into_instruction(-(length + 7), write.dispOffset, IMM_32, write.source);
+	insert_immxx_into_instruction(length, write.immOffset, IMM_32, write.source);
+	write_object_code(obj, write.source, write.length);
 }
@@ -6,6 +6,16 @@
 #define BC_ELF_H
 #include "bc.h"
 
-void elf_produce (const struct stream*, const char*, const unsigned int, const unsigned char);
+/* native code compiled out of a slice of the stream, takes the address of
+ * the current cell and returns where the pointer ended up
+ */
+typedef void *(*elf_native_t) (void*);
+
+void elf_produce (const struct stream*, const char*, const unsigned int, const unsigned char, const bool, const enum eof, const struct image*);
+void elf_produce_streaming (FILE*, const char*, const char*, const unsigned int, const unsigned char, const bool, const enum eof);
+void elf_jit (const struct stream*, const unsigned int, const unsigned char, const bool, const enum eof);
+
+elf_native_t elf_jit_fragment (const struct token*, const size_t, const unsigned char);
+void elf_jit_release (elf_native_t);
 
 #endif
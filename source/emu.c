@@ -3,23 +3,133 @@
  * Memory (tape) emulator
  */
 #include "emu.h"
+#include "elf.h"
 #include "fatal.h"
 
+#include <errno.h>
+#include <signal.h>
 #include <stdlib.h>
+#include <string.h>
 #include <limits.h>
+#include <sys/mman.h>
+
+/* guard-page mode: the tape lives between two PROT_NONE ranges this big
+ * (only address space is reserved), any access past either end faults
+ */
+#define GUARD_PAGES_LENGTH   (1UL << 32)
+#define GUARD_PAGE_SIZE      4096
+
+#define SNAPSHOT_MAGIC       "bcsnap"
+#define SNAPSHOT_VERSION     1
 
 struct Memory
 {
 	void          *memory;
 	unsigned long max;
-	unsigned int  at;
+	signed long   at;
+	signed long   lowest;
+	signed long   highest;
 	unsigned int  tapesz;
 	unsigned char cellsz;
 	bool          safe;
+	bool          unbounded;
+
+	/* pre-evaluation (see 'emu_pre_evaluate'): tokens left to run (zero when
+	 * not pre-evaluating), which token it stopped at and where output goes
+	 */
+	unsigned long budget;
+	size_t        stopped;
+	FILE          *out;
+};
+
+/* Tiered execution: back-edges taken per loop are counted (keyed by 'nolbl')
+ * and once a loop crosses 'threshold' it is handed to elf.c, from then on
+ * the whole loop runs as native code every time it is reached
+ */
+struct Tiering
+{
+	unsigned long *hotness;
+	elf_native_t  *native;
+	unsigned long threshold;
+};
+
+/* The token being emulated is kept here so the SIGSEGV handler can say which
+ * one went out of bounds; 'low' and 'high' are the tape limits. 'stream' is
+ * where its location is found (see 'locate'). One per thread, batch workers
+ * pre-evaluate (-p) on their own (see main.c) and the handler runs on the
+ * thread that faulted
+ */
+static _Thread_local struct
+{
+	const struct token *volatile current;
+	const struct stream          *stream;
+	unsigned char                *base;
+	unsigned char                *low;
+	unsigned char                *high;
+	size_t                       length;
+} Guard;
+
+static void *map_guarded_tape (struct Memory*);
+static void *map_unbounded_tape (void);
+static void handle_guard_fault (int, siginfo_t*, void*);
+static const struct location *locate (const struct token*);
+
+/* Checkpoints: the whole machine (tape, pointer, program counter and how far
+ * stdin/stdout went) is dumped into 'filename' every 'every' tokens and when
+ * SIGUSR1 (carry on) or SIGTERM (leave) arrives; '--resume' picks it up later.
+ * Only the touched extent of the tape ('lowest'..'highest') is stored
+ */
+struct Snapshot
+{
+	const char    *filename;
+	unsigned long every;
+	unsigned long next;
+	unsigned long steps;
+	unsigned long inputs;
+	unsigned long outputs;
+};
+
+struct SnapshotHeader
+{
+	char          magic[8];
+	unsigned int  version;
+	unsigned int  tapesz;
+	unsigned long proglen;
+	unsigned long progsum;
+	unsigned long pc;
+	unsigned long steps;
+	unsigned long inputs;
+	unsigned long outputs;
+	signed long   at;
+	signed long   lowest;
+	signed long   highest;
+	signed long   first;
+	unsigned long nocells;
+	unsigned char cellsz;
+	unsigned char unbounded;
 };
 
+static volatile sig_atomic_t SnapshotSignal = 0;
+
+static void handle_snapshot_signal (int);
+static void checkpoint (const struct bc*, const struct Memory*, const size_t, struct Snapshot*);
+static unsigned long program_checksum (const struct stream*);
+
+static bool is_zero_cell (const unsigned char*, const unsigned char);
+static void save_snapshot (const struct bc*, const struct Memory*, const size_t, const struct Snapshot*);
+static size_t load_snapshot (const struct bc*, struct Memory*, struct Snapshot*);
+
+static unsigned long count_labels (const struct stream*);
+static size_t *resolve_jumps (const struct stream*);
+
+static size_t tier_back_edge (struct Tiering*, const struct stream*, const size_t*, const size_t, struct Memory*);
+static void tier_run_native (const elf_native_t, struct Memory*);
+
 inline static void handle_next (struct token*, struct Memory*);
 inline static void handle_prev (struct token*, struct Memory*);
+static void handle_scan (const struct token*, struct Memory*);
+static bool pre_evaluation_goes_on (const struct token*, struct Memory*);
+inline static void mark_touched (struct Memory*);
 
 inline static void handle_add8 (struct token*, struct Memory*);
 inline static void handle_dec8 (struct token*, struct Memory*);
@@ -33,81 +143,962 @@ inline static void handle_dec32 (struct token*, struct Memory*);
 inline static void handle_add64 (struct token*, struct Memory*);
 inline static void handle_dec64 (struct token*, struct Memory*);
 
+inline static unsigned long load_8  (struct Memory*);
+inline static unsigned long load_16 (struct Memory*);
+
+inline static unsigned long load_32 (struct Memory*);
+inline static unsigned long load_64 (struct Memory*);
+
+inline static void store_8  (struct Memory*, const unsigned long);
+inline static void store_16 (struct Memory*, const unsigned long);
+
+inline static void store_32 (struct Memory*, const unsigned long);
+inline static void store_64 (struct Memory*, const unsigned long);
+
 inline static void display_8  (struct Memory*, const unsigned int, const unsigned int, const unsigned int);
 inline static void display_16 (struct Memory*, const unsigned int, const unsigned int, const unsigned int);
 
 inline static void display_32 (struct Memory*, const unsigned int, const unsigned int, const unsigned int);
 inline static void display_64 (struct Memory*, const unsigned int, const unsigned int, const unsigned int);
 
-void emu_emulate (const struct stream *stream, const unsigned int tapesz, const unsigned char cellsz, const bool safeMode, const unsigned int offset, const unsigned int display, const unsigned int group)
+typedef void (*display_t) (struct Memory*, const unsigned int, const unsigned int, const unsigned int);
+typedef unsigned long (*load_t) (struct Memory*);
+
+static load_t loader_for (const unsigned char);
+
+static void emulate_switch (const struct bc*, struct Memory*, const size_t*, size_t, struct Snapshot*);
+static void profile_report (const struct stream*, const size_t*, const unsigned long*, const unsigned int);
+
+#if defined(__GNUC__)
+static void emulate_threaded_8  (const struct bc*, struct Memory*, const size_t*);
+static void emulate_threaded_16 (const struct bc*, struct Memory*, const size_t*);
+
+static void emulate_threaded_32 (const struct bc*, struct Memory*, const size_t*);
+static void emulate_threaded_64 (const struct bc*, struct Memory*, const size_t*);
+#endif
+
+void emu_emulate (const struct bc *bc)
 {
+	const struct stream *stream = &bc->stream;
+
 	struct Memory mem = {
 		.at = 0,
-		.tapesz = tapesz,
-		.cellsz = cellsz,
-		.safe     = safeMode
+		.tapesz = bc->args.tapesz,
+		.cellsz = bc->args.cellsz,
+		.safe     = bc->args.safeMode && !bc->args.guard,
+		.unbounded = bc->args.unbounded,
+		.out       = stdout
+	};
+
+	switch (mem.cellsz)
+	{
+		case 1: { mem.max = UCHAR_MAX; break; }
+		case 2: { mem.max = USHRT_MAX; break; }
+		case 4: { mem.max = UINT_MAX;  break; }
+		case 8: { mem.max = ULONG_MAX; break; }
+	}
+
+	if (bc->args.unbounded)    { mem.memory = map_unbounded_tape(); }
+	else if (bc->args.guard)   { mem.memory = map_guarded_tape(&mem); }
+	else                       { mem.memory = calloc(mem.tapesz, mem.cellsz); }
+	CHECK_POINTER(mem.memory, "reserving space to emulate memory");
+
+	size_t *jumps = resolve_jumps(stream);
+
+	struct Snapshot snap = { .filename = bc->args.checkpoint, .every = bc->args.every };
+	size_t start = 0;
+
+	if (bc->args.resume)
+	{
+		start = load_snapshot(bc, &mem, &snap);
+	}
+	if (snap.filename)
+	{
+		snap.next = snap.every ? snap.steps + snap.every : ULONG_MAX;
+
+		/* no SA_RESTART: a run blocked on ',' gets EINTR and snapshots
+		 * right away instead of once some input arrives
+		 */
+		struct sigaction action = { .sa_handler = handle_snapshot_signal };
+		sigemptyset(&action.sa_mask);
+		sigaction(SIGUSR1, &action, NULL);
+		sigaction(SIGTERM, &action, NULL);
+	}
+
+	/* safe mode needs the per-token checks, the threaded engine only exists
+	 * to go fast and does not carry them; tiering, profiling, guard pages
+	 * (which need to know the current token) and checkpoints live in the
+	 * switch engine
+	 */
+#if defined(__GNUC__)
+	if (bc->args.threaded && !bc->args.tiered && !bc->args.profile && !bc->args.guard && !mem.safe && !snap.filename && !start)
+	{
+		switch (mem.cellsz)
+		{
+			case 1: emulate_threaded_8 (bc, &mem, jumps); break;
+			case 2: emulate_threaded_16(bc, &mem, jumps); break;
+			case 4: emulate_threaded_32(bc, &mem, jumps); break;
+			case 8: emulate_threaded_64(bc, &mem, jumps); break;
+		}
+	}
+	else
+#endif
+	{
+		emulate_switch(bc, &mem, jumps, start, snap.filename ? &snap : NULL);
+	}
+
+	free(jumps);
+	if (bc->args.unbounded)  { munmap((unsigned char*) mem.memory - UNBOUNDED_TAPE_LENGTH / 2, UNBOUNDED_TAPE_LENGTH); }
+	else if (bc->args.guard) { munmap(Guard.base, Guard.length); }
+	else                     { free(mem.memory); }
+
+	if (bc->args.safeMode || bc->args.guard)
+	{
+		puts("All is within bounds :) good job!");
+	}
+}
+
+void emu_pre_evaluate (const struct bc *bc, struct image *image)
+{
+	const struct stream *stream = &bc->stream;
+	memset(image, 0, sizeof(*image));
+
+	struct Memory mem = {
+		.at      = 0,
+		.tapesz  = bc->args.tapesz,
+		.cellsz  = bc->args.cellsz,
+		.budget  = bc->args.budget,
+		.stopped = stream->length
 	};
 
+	mem.memory = calloc(mem.tapesz, mem.cellsz);
+	CHECK_POINTER(mem.memory, "reserving space to pre-evaluate");
+
+	mem.out = open_memstream(&image->output, &image->outlen);
+	CHECK_POINTER(mem.out, "capturing the pre-evaluated output");
+
+	size_t *jumps = resolve_jumps(stream);
+	emulate_switch(bc, &mem, jumps, 0, NULL);
+	free(jumps);
+
+	if (fclose(mem.out)) { fatal_file_ops("<pre-evaluated output>"); }
+
+	/* the rest of the tape is zero once loaded, no need to store it
+	 */
+	const unsigned char *tape = (const unsigned char*) mem.memory;
+	size_t length = (size_t) mem.tapesz * mem.cellsz;
+	while (length && tape[length - 1] == 0) { length--; }
+
+	image->tape   = (unsigned char*) mem.memory;
+	image->length = length;
+	image->resume = mem.stopped;
+	image->at     = mem.at;
+}
+
+static void emulate_switch (const struct bc *bc, struct Memory *mem, const size_t *jumps, size_t start, struct Snapshot *snap)
+{
+	const struct stream *stream = &bc->stream;
+
 	typedef void (*incdec_t) (struct token*, struct Memory*);
-	typedef void (*display_t) (struct Memory*, const unsigned int, const unsigned int, const unsigned int);
+	typedef void (*store_t) (struct Memory*, const unsigned long);
 
 	incdec_t inc, dec;
 	display_t dis;
+	load_t load;
+	store_t store;
 
-	switch (cellsz)
+	switch (mem->cellsz)
 	{
-		case 1: { mem.memory = (unsigned char*)  calloc(tapesz, sizeof(unsigned char));  mem.max = UCHAR_MAX; inc = handle_add8 ; dec = handle_dec8 ; dis = display_8 ; break; }
-		case 2: { mem.memory = (unsigned short*) calloc(tapesz, sizeof(unsigned short)); mem.max = USHRT_MAX; inc = handle_add16; dec = handle_dec16; dis = display_16; break; }
-		case 4: { mem.memory = (unsigned int*)   calloc(tapesz, sizeof(unsigned int));   mem.max = UINT_MAX;  inc = handle_add32; dec = handle_dec32; dis = display_32; break; }
-		case 8: { mem.memory = (unsigned long*)  calloc(tapesz, sizeof(unsigned long));  mem.max = ULONG_MAX; inc = handle_add64; dec = handle_dec64; dis = display_64; break; }
+		case 1: { inc = handle_add8 ; dec = handle_dec8 ; dis = display_8 ; load = load_8 ; store = store_8 ; break; }
+		case 2: { inc = handle_add16; dec = handle_dec16; dis = display_16; load = load_16; store = store_16; break; }
+		case 4: { inc = handle_add32; dec = handle_dec32; dis = display_32; load = load_32; store = store_32; break; }
+		case 8: { inc = handle_add64; dec = handle_dec64; dis = display_64; load = load_64; store = store_64; break; }
 	}
 
-	CHECK_POINTER(mem.memory, "reserving space to emulate memory");
+	/* native code comes from the amd64 emitters, other hosts always interpret
+	 */
+	struct Tiering tier = { .threshold = bc->args.hotness };
+	const unsigned long nolabels = count_labels(stream);
 
-	for (size_t i = 0; i < stream->length; i++)
+	/* profiling counts every token executed, so nothing may run natively
+	 */
+	unsigned long *counts = NULL;
+	if (bc->args.profile)
+	{
+		counts = (unsigned long*) calloc(stream->length + 1, sizeof(unsigned long));
+		CHECK_POINTER(counts, "reserving space for profiling counters");
+	}
+
+	/* native loops cannot be stopped halfway, so no tiering with checkpoints
+	 */
+#if defined(__x86_64__)
+	if (bc->args.tiered && !bc->args.profile && !mem->safe && !snap)
+	{
+		tier.hotness = (unsigned long*) calloc(nolabels + 1, sizeof(unsigned long));
+		tier.native  = (elf_native_t*)  calloc(nolabels + 1, sizeof(elf_native_t));
+		CHECK_POINTER(tier.hotness, "reserving space for loop counters");
+		CHECK_POINTER(tier.native,  "reserving space for loop counters");
+	}
+#endif
+
+	Guard.stream = stream;
+	for (size_t i = start; i < stream->length; i++)
 	{
 		struct token *t = &stream->stream[i];
-		switch (t->meta.mnemonic)
+		Guard.current = t;
+		if (counts) { counts[i]++; }
+
+		if (snap && (++snap->steps >= snap->next || SnapshotSignal))
+		{
+			checkpoint(bc, mem, i, snap);
+		}
+		if (mem->budget && !pre_evaluation_goes_on(t, mem))
+		{
+			mem->stopped = i;
+			break;
+		}
+
+		switch (t->mnemonic)
 		{
-			case '+': inc(t, &mem);         break;
-			case '-': dec(t, &mem);         break;
-			case '>': handle_next(t, &mem); break;
-			case '<': handle_prev(t, &mem); break;
+			case '+':
+			case '-':
+			case MNEMONIC_SET:
+			{
+				/* the cell may be away from the pointer (see opt.c), 'at' is
+				 * moved there and back
+				 */
+				mem->at += t->offset;
+				if (t->mnemonic == '+')      { inc(t, mem); }
+				else if (t->mnemonic == '-') { dec(t, mem); }
+				else                              { store(mem, t->groupSize); }
+
+				if (t->offset) { mark_touched(mem); }
+				mem->at -= t->offset;
+				break;
+			}
+			case '>': handle_next(t, mem); break;
+			case '<': handle_prev(t, mem); break;
+			case '[':
+			{
+				if (load(mem) == 0)
+				{
+					i = jumps[i];
+				}
+				else if (tier.native && tier.native[t->nolbl])
+				{
+					tier_run_native(tier.native[t->nolbl], mem);
+					i = jumps[i];
+				}
+				break;
+			}
+			case ']':
+			{
+				if (load(mem) == 0) { break; }
+				i = tier.native ? tier_back_edge(&tier, stream, jumps, i, mem) : jumps[i];
+				break;
+			}
+			case '.':
+			{
+				const int c = (unsigned char) load(mem);
+				for (unsigned long k = 0; k < t->groupSize; k++) { putc(c, mem->out); }
+				if (snap) { snap->outputs += t->groupSize; }
+				break;
+			}
+			case ',':
+			{
+				/* EOF does what -e says, the same thing a generated binary
+				 * does once its read(2) returns nothing
+				 */
+				for (unsigned long k = 0; k < t->groupSize; k++)
+				{
+					const int c = getchar();
+					if (c == EOF && snap && ferror(stdin) && errno == EINTR)
+					{
+						/* a snapshot signal broke the read: the token is
+						 * taken as not started, what it read so far is read
+						 * again on resume
+						 */
+						clearerr(stdin);
+						if (SnapshotSignal)
+						{
+							snap->inputs -= k;
+							checkpoint(bc, mem, i, snap);
+							snap->inputs += k;
+						}
+						k--;
+						continue;
+					}
+					if (c == EOF)
+					{
+						if (bc->args.eof != EOF_UNCHANGED) { store(mem, bc->args.eof == EOF_ZERO ? 0 : -1UL); }
+						continue;
+					}
+
+					store(mem, (unsigned long) c);
+					if (snap) { snap->inputs++; }
+				}
+				break;
+			}
+			case MNEMONIC_SCAN: handle_scan(t, mem); break;
+			case MNEMONIC_PRINT:
+			{
+				fwrite(stream->literals + t->offset, 1, t->groupSize, mem->out);
+				if (snap) { snap->outputs += t->groupSize; }
+				break;
+			}
+			case MNEMONIC_MUL:
+			{
+				const unsigned long product = load(mem) * t->groupSize;
+				mem->at += t->offset;
+				store(mem, load(mem) + product);
+
+				mark_touched(mem);
+				mem->at -= t->offset;
+				break;
+			}
 			case '@':
 			{
-				if (safeMode) continue;
-				printf("debbug at %ld chunk-instruction from %d cell:\n", i - 1, offset);
+				if (mem->safe) continue;
+				printf("debbug at %ld chunk-instruction from %d cell:\n", i - 1, bc->args.offset);
 
-				dis(&mem, offset, display, group);
+				dis(mem, bc->args.offset, bc->args.display, bc->args.group);
 				printf("\n\n");
 				break;
 			}
 		}
 	}
 
-	if (safeMode)
+	for (unsigned long l = 0; tier.native && l < nolabels; l++)
 	{
-		puts("All is within bounds :) good job!");
+		if (tier.native[l]) { elf_jit_release(tier.native[l]); }
+	}
+	free(tier.hotness);
+	free(tier.native);
+
+	if (counts)
+	{
+		profile_report(stream, jumps, counts, bc->args.profileTop);
+		free(counts);
+	}
+}
+
+struct hotloop
+{
+	size_t        open;
+	unsigned long cost;
+};
+
+static int compare_hotloops (const void *a, const void *b)
+{
+	const unsigned long x = ((const struct hotloop*) a)->cost;
+	const unsigned long y = ((const struct hotloop*) b)->cost;
+	return (x < y) - (x > y);
+}
+
+static void profile_report (const struct stream *stream, const size_t *jumps, const unsigned long *counts, const unsigned int top)
+{
+	/* the report goes to stderr so it never mixes with the program's output.
+	 * Source lines are recovered from the tokens: 'context - offline' is
+	 * where the line begins
+	 */
+	fflush(stdout);
+
+	unsigned long total = 0;
+	for (size_t i = 0; i < stream->length; i++) { total += counts[i]; }
+
+	const double percent = total ? 100.0 / (double) total : 0.0;
+
+	fprintf(stderr, "\nbc: profile, %lu tokens executed\n", total);
+	fprintf(stderr, "  %-7s %-14s %-8s %s\n", "line", "count", "%", "source");
+
+	for (size_t i = 0; i < stream->length;)
+	{
+		const struct location *first = &stream->where[i];
+		unsigned long linecount = 0;
+
+		for (; i < stream->length && stream->where[i].numline == first->numline; i++)
+		{
+			linecount += counts[i];
+		}
+
+		const char *line = first->context - first->offline;
+		int linelen = 0;
+		for (; line[linelen] && line[linelen] != '\n'; linelen++)
+			 ;
+
+		fprintf(stderr, "  %-7lu %-14lu %6.2f%%  %.*s\n", first->numline, linecount, (double) linecount * percent, linelen, line);
+	}
+
+	struct hotloop *loops = (struct hotloop*) calloc(stream->length + 1, sizeof(struct hotloop));
+	unsigned long *upto   = (unsigned long*) calloc(stream->length + 1, sizeof(unsigned long));
+	CHECK_POINTER(loops, "sorting loops by cost");
+	CHECK_POINTER(upto, "sorting loops by cost");
+
+	/* running sums make every loop cost a subtraction, nested loops
+	 * would be walked once per level otherwise
+	 */
+	for (size_t i = 0; i < stream->length; i++) { upto[i + 1] = upto[i] + counts[i]; }
+
+	size_t noloops = 0;
+	for (size_t i = 0; i < stream->length; i++)
+	{
+		if (stream->stream[i].mnemonic != '[') { continue; }
+
+		struct hotloop *loop = &loops[noloops++];
+		loop->open = i;
+		loop->cost = upto[jumps[i] + 1] - upto[i];
+	}
+
+	free(upto);
+
+	qsort(loops, noloops, sizeof(struct hotloop), compare_hotloops);
+	fprintf(stderr, "\n  hottest loops (cost includes nested loops):\n");
+
+	for (size_t l = 0; l < noloops && l < top; l++)
+	{
+		const struct location *open  = &stream->where[loops[l].open];
+		const struct location *close = &stream->where[jumps[loops[l].open]];
+
+		int show = 0;
+		for (; show < 40 && open->context + show <= close->context && open->context[show] != '\n'; show++)
+			 ;
+
+		fprintf(
+			stderr, "  #%-4zu %5lu:%-5lu %-14lu %6.2f%%  %lu iterations  %.*s\n", l + 1,
+			open->numline, open->offline, loops[l].cost, (double) loops[l].cost * percent,
+			counts[jumps[loops[l].open]], show, open->context
+		);
 	}
+
+	free(loops);
+}
+
+static size_t tier_back_edge (struct Tiering *tier, const struct stream *stream, const size_t *jumps, const size_t close, struct Memory *mem)
+{
+	const size_t open = jumps[close];
+	const unsigned long label = stream->stream[close].nolbl;
+
+	/* the compilation is tried just once, when the counter crosses the
+	 * threshold. Loops reading input or debugging stay interpreted since
+	 * those go through stdio
+	 */
+	if (++tier->hotness[label] == tier->threshold)
+	{
+		bool compilable = true;
+		for (size_t k = open; k <= close && compilable; k++)
+		{
+			const char mnemonic = stream->stream[k].mnemonic;
+			compilable = (mnemonic != ',') && (mnemonic != '@');
+		}
+		if (compilable)
+		{
+			tier->native[label] = elf_jit_fragment(&stream->stream[open], close - open + 1, mem->cellsz);
+		}
+	}
+
+	if (tier->native[label] == NULL)
+	{
+		return open;
+	}
+
+	/* the native code starts at '[' which tests the cell once again, once
+	 * it returns the interpreter carries on right after ']'
+	 */
+	tier_run_native(tier->native[label], mem);
+	return close;
+}
+
+static void tier_run_native (const elf_native_t native, struct Memory *mem)
+{
+	/* native '.' writes with syscalls, whatever stdio holds must go first
+	 */
+	fflush(stdout);
+
+	unsigned char *tape = (unsigned char*) mem->memory;
+	unsigned char *cell = (unsigned char*) native(tape + (size_t) mem->at * mem->cellsz);
+
+	mem->at = (signed long) ((cell - tape) / (signed long) mem->cellsz);
+}
+
+static void *map_guarded_tape (struct Memory *mem)
+{
+	/* layout: [ guard | tape | guard ], the tape is rounded up to whole pages
+	 * so both of its ends touch a guard, which makes '<' and '>' free of any
+	 * check; the tape only grows, '-T' is a lower bound anyways
+	 */
+	const size_t tapelen = ((size_t) mem->tapesz * mem->cellsz + GUARD_PAGE_SIZE - 1) & ~((size_t) GUARD_PAGE_SIZE - 1);
+
+	Guard.length = GUARD_PAGES_LENGTH + tapelen + GUARD_PAGES_LENGTH;
+	Guard.base   = (unsigned char*) mmap(NULL, Guard.length, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+	if (Guard.base == MAP_FAILED || mprotect(Guard.base + GUARD_PAGES_LENGTH, tapelen, PROT_READ | PROT_WRITE))
+	{
+		return NULL;
+	}
+
+	Guard.low   = Guard.base + GUARD_PAGES_LENGTH;
+	Guard.high  = Guard.low + tapelen;
+	mem->tapesz = (unsigned int) (tapelen / mem->cellsz);
+
+	struct sigaction action = { .sa_sigaction = handle_guard_fault, .sa_flags = SA_SIGINFO };
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGSEGV, &action, NULL);
+
+	return Guard.low;
+}
+
+static void *map_unbounded_tape (void)
+{
+	/* only address space is reserved, the kernel commits zeroed pages as
+	 * the program touches them. The origin is the middle so the pointer can
+	 * go either way
+	 */
+	unsigned char *tape = (unsigned char*) mmap(NULL, UNBOUNDED_TAPE_LENGTH, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	return (tape == MAP_FAILED) ? NULL : tape + UNBOUNDED_TAPE_LENGTH / 2;
+}
+
+static void handle_guard_fault (int signo, siginfo_t *info, void *context)
+{
+	(void) context;
+	const unsigned char *address = (const unsigned char*) info->si_addr;
+	const struct token *t = Guard.current;
+
+	/* not one of ours, let it crash as usual
+	 */
+	if (t == NULL || address < Guard.base || address >= (Guard.base + Guard.length))
+	{
+		signal(signo, SIG_DFL);
+		return;
+	}
+
+	fflush(stdout);
+	const enum FatalSourceKind kind = (address < Guard.low) ? FATAL_SRC_SAFE_MODE_PREV_UNDRFLOW : FATAL_SRC_SAFE_MODE_NEXT_OVERFLOW;
+	fatal_source_fatal(FATAL_BREAKDOWN_LOCATION(locate(t)), kind, FATAL_ISNT_MULTIPLE);
+}
+
+static const struct location *locate (const struct token *t)
+{
+	/* only the switch engine reports (safe mode, guard pages), tokens come
+	 * from the stream it is running
+	 */
+	return &Guard.stream->where[t - Guard.stream->stream];
+}
+
+static void handle_snapshot_signal (int signo)
+{
+	SnapshotSignal = signo;
+}
+
+static void checkpoint (const struct bc *bc, const struct Memory *mem, const size_t pc, struct Snapshot *snap)
+{
+	/* 'pc' has not run yet, which is where a resumed run starts. SIGTERM
+	 * leaves as a killed process would, so whoever sent it can tell
+	 */
+	snap->steps--;
+	save_snapshot(bc, mem, pc, snap);
+	snap->steps++;
+
+	if (SnapshotSignal == SIGTERM) { exit(128 + SIGTERM); }
+	SnapshotSignal = 0;
+	snap->next = snap->every ? snap->steps + snap->every : ULONG_MAX;
+}
+
+static unsigned long program_checksum (const struct stream *stream)
+{
+	/* FNV-1a over what the program does, a snapshot taken from a different
+	 * program must not be resumed
+	 */
+	unsigned long hash = 0xcbf29ce484222325UL;
+	for (size_t i = 0; i < stream->length; i++)
+	{
+		hash = (hash ^ (unsigned char) stream->stream[i].mnemonic) * 0x100000001b3UL;
+		hash = (hash ^ stream->stream[i].groupSize) * 0x100000001b3UL;
+	}
+	return hash;
+}
+
+static bool is_zero_cell (const unsigned char *cell, const unsigned char cellsz)
+{
+	for (unsigned char b = 0; b < cellsz; b++)
+	{
+		if (cell[b]) { return false; }
+	}
+	return true;
+}
+
+static void save_snapshot (const struct bc *bc, const struct Memory *mem, const size_t pc, const struct Snapshot *snap)
+{
+	fflush(stdout);
+
+	/* trims the zeroes at both ends of the touched extent, those come back
+	 * for free when resuming
+	 */
+	const unsigned char *tape = (const unsigned char*) mem->memory;
+	signed long first = mem->lowest, last = mem->highest;
+
+	for (; first <= last && is_zero_cell(tape + first * mem->cellsz, mem->cellsz); first++)
+		 ;
+	for (; last >= first && is_zero_cell(tape + last * mem->cellsz, mem->cellsz); last--)
+		 ;
+
+	struct SnapshotHeader header = {
+		.magic     = SNAPSHOT_MAGIC,
+		.version   = SNAPSHOT_VERSION,
+		.tapesz    = mem->tapesz,
+		.proglen   = bc->stream.length,
+		.progsum   = program_checksum(&bc->stream),
+		.pc        = pc,
+		.steps     = snap->steps,
+		.inputs    = snap->inputs,
+		.outputs   = snap->outputs,
+		.at        = mem->at,
+		.lowest    = mem->lowest,
+		.highest   = mem->highest,
+		.first     = first,
+		.nocells   = (unsigned long) (last - first + 1),
+		.cellsz    = mem->cellsz,
+		.unbounded = bc->args.unbounded
+	};
+
+	/* written aside then renamed, a job killed halfway through a dump still
+	 * has the previous snapshot
+	 */
+	char temporal[FILENAME_MAX];
+	snprintf(temporal, sizeof(temporal), "%s.tmp", snap->filename);
+
+	FILE *file = fopen(temporal, "wb");
+	if (file == NULL)
+	{
+		fatal_file_ops(temporal);
+	}
+
+	const size_t length = header.nocells * mem->cellsz;
+	if (fwrite(&header, sizeof(header), 1, file) != 1)                              { fatal_file_ops(temporal); }
+	if (length && fwrite(tape + first * mem->cellsz, 1, length, file) != length)    { fatal_file_ops(temporal); }
+	if (fclose(file) || rename(temporal, snap->filename))                           { fatal_file_ops(snap->filename); }
+}
+
+static size_t load_snapshot (const struct bc *bc, struct Memory *mem, struct Snapshot *snap)
+{
+	const char *filename = bc->args.resume;
+	FILE *file = fopen(filename, "rb");
+	if (file == NULL)
+	{
+		fatal_file_ops(filename);
+	}
+
+	struct SnapshotHeader header;
+	if (fread(&header, sizeof(header), 1, file) != 1)
+	{
+		fatal_snapshot_ops(filename, "truncated header");
+	}
+
+	if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) || header.version != SNAPSHOT_VERSION)
+	{
+		fatal_snapshot_ops(filename, "not a bc snapshot (or from another version)");
+	}
+	if (header.proglen != bc->stream.length || header.progsum != program_checksum(&bc->stream))
+	{
+		fatal_snapshot_ops(filename, "taken from a different program");
+	}
+	if (header.cellsz != mem->cellsz || header.unbounded != bc->args.unbounded)
+	{
+		fatal_snapshot_ops(filename, "taken with a different cell size or tape kind (-C, -U)");
+	}
+
+	/* nothing from the file is trusted to stay within the program or the
+	 * tape (cells from the middle either way when unbounded); capping
+	 * 'nocells' to the room left also keeps its length in bytes in range
+	 */
+	const signed long lo = bc->args.unbounded ? -(signed long) (UNBOUNDED_TAPE_LENGTH / 2 / mem->cellsz) : 0;
+	const signed long hi = bc->args.unbounded ?  (signed long) (UNBOUNDED_TAPE_LENGTH / 2 / mem->cellsz) : (signed long) mem->tapesz;
+
+	if (header.pc > bc->stream.length)
+	{
+		fatal_snapshot_ops(filename, "its program counter is past the program");
+	}
+	if (header.at < lo || header.at >= hi || header.lowest < lo || header.highest >= hi || header.lowest > header.at || header.at > header.highest)
+	{
+		fatal_snapshot_ops(filename, "its pointer is not within the tape");
+	}
+	if (header.first < lo || header.first > hi || header.nocells > (unsigned long) (hi - header.first))
+	{
+		fatal_snapshot_ops(filename, bc->args.unbounded ? "its tape is not within the unbounded tape" : "its tape does not fit, use a bigger -T");
+	}
+	if (header.nocells && (header.first < header.lowest || header.first + (signed long) header.nocells - 1 > header.highest))
+	{
+		fatal_snapshot_ops(filename, "its tape is not within the touched extent");
+	}
+
+	unsigned char *tape = (unsigned char*) mem->memory;
+	const size_t length = header.nocells * mem->cellsz;
+
+	if (length && fread(tape + header.first * mem->cellsz, 1, length, file) != length)
+	{
+		fatal_snapshot_ops(filename, "truncated tape");
+	}
+	fclose(file);
+
+	mem->at       = header.at;
+	mem->lowest   = header.lowest;
+	mem->highest  = header.highest;
+	snap->steps   = header.steps;
+	snap->inputs  = header.inputs;
+	snap->outputs = header.outputs;
+
+	/* whatever the previous run already read is consumed again, so the same
+	 * input can be fed to the resumed run
+	 */
+	for (unsigned long k = 0; k < header.inputs && getchar() != EOF; k++)
+		 ;
+	return header.pc;
+}
+
+static unsigned long count_labels (const struct stream *stream)
+{
+	unsigned long nolabels = 0;
+	for (size_t i = 0; i < stream->length; i++)
+	{
+		if (stream->stream[i].mnemonic == '[') { nolabels = stream->stream[i].nolbl + 1; }
+	}
+	return nolabels;
+}
+
+#if defined(__GNUC__)
+/* Direct-threaded engine: the stream is decoded once into 'struct threaded'
+ * whose 'handler' is the address of the label implementing the token
+ * (labels-as-values), every handler finishes jumping straight into the next
+ * one so there is no central dispatch nor indirect calls. Cell width is fixed
+ * at compile time, one engine per width is generated by DEFINE_THREADED_ENGINE
+ */
+struct threaded
+{
+	const void *handler;
+	union
+	{
+		unsigned long      imm;
+		struct threaded    *jump;
+		const struct token *token;
+	} arg;
+};
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+#define DEFINE_THREADED_ENGINE(name, type, displayer)                                            \
+static void name (const struct bc *bc, struct Memory *mem, const size_t *jumps)                \
+{                                                                                                \
+	const struct stream *stream = &bc->stream;                                                   \
+	struct threaded *code = (struct threaded*) calloc(stream->length + 1, sizeof(*code));        \
+	CHECK_POINTER(code, "decoding tokens for the threaded engine");                             \
+                                                                                                 \
+	for (size_t i = 0; i < stream->length; i++)                                                  \
+	{                                                                                            \
+		const struct token *t = &stream->stream[i];                                              \
+		code[i].arg.imm = t->groupSize;                                                          \
+		if (t->offset) { code[i].arg.token = t; }                                                \
+		switch (t->mnemonic)                                                                \
+		{                                                                                        \
+			case '+': code[i].handler = t->offset ? &&addo : &&add; break;                       \
+			case '-': code[i].handler = t->offset ? &&subo : &&sub; break;                       \
+			case '>': code[i].handler = &&nxt; break;                                            \
+			case '<': code[i].handler = &&prv; break;                                            \
+			case '.': code[i].handler = &&out; break;                                            \
+			case ',': code[i].handler = &&inp; break;                                            \
+			case '[': code[i].handler = &&lbr; code[i].arg.jump = &code[jumps[i] + 1]; break;    \
+			case ']': code[i].handler = &&rbr; code[i].arg.jump = &code[jumps[i] + 1]; break;    \
+			case '@': code[i].handler = &&dbg; code[i].arg.imm  = i; break;                      \
+			case MNEMONIC_SET: code[i].handler = t->offset ? &&seto : &&set; break;              \
+			case MNEMONIC_MUL: code[i].handler = &&mul; code[i].arg.token = t; break;            \
+			case MNEMONIC_SCAN: code[i].handler = &&scn; code[i].arg.token = t; break;           \
+			case MNEMONIC_PRINT: code[i].handler = &&prt; code[i].arg.token = t; break;          \
+		}                                                                                        \
+	}                                                                                            \
+	code[stream->length].handler = &&end;                                                        \
+                                                                                                 \
+	type *const tape = (type*) mem->memory;                                                      \
+	type *cell = tape;                                                                           \
+	struct threaded *pc = code;                                                                  \
+	goto *pc->handler;                                                                           \
+                                                                                                 \
+	add: *cell += (type) pc->arg.imm; pc++; goto *pc->handler;                                   \
+	sub: *cell -= (type) pc->arg.imm; pc++; goto *pc->handler;                                   \
+	set: *cell  = (type) pc->arg.imm; pc++; goto *pc->handler;                                   \
+	addo: cell[pc->arg.token->offset] += (type) pc->arg.token->groupSize; pc++; goto *pc->handler; \
+	subo: cell[pc->arg.token->offset] -= (type) pc->arg.token->groupSize; pc++; goto *pc->handler; \
+	seto: cell[pc->arg.token->offset]  = (type) pc->arg.token->groupSize; pc++; goto *pc->handler; \
+	mul:                                                                                         \
+		cell[pc->arg.token->offset] += (type) (*cell * pc->arg.token->groupSize);                \
+		pc++; goto *pc->handler;                                                                 \
+	prt:                                                                                         \
+		fwrite(stream->literals + pc->arg.token->offset, 1, pc->arg.token->groupSize, stdout);   \
+		pc++; goto *pc->handler;                                                                 \
+	scn:                                                                                         \
+		mem->at = (signed long) (cell - tape);                                                   \
+		handle_scan(pc->arg.token, mem);                                                         \
+		cell = tape + mem->at;                                                                   \
+		pc++; goto *pc->handler;                                                                 \
+	nxt: cell += pc->arg.imm; pc++; goto *pc->handler;                                           \
+	prv: cell -= pc->arg.imm; pc++; goto *pc->handler;                                           \
+	lbr: pc = (*cell == 0) ? pc->arg.jump : pc + 1; goto *pc->handler;                           \
+	rbr: pc = (*cell != 0) ? pc->arg.jump : pc + 1; goto *pc->handler;                           \
+	out:                                                                                         \
+		for (unsigned long k = 0; k < pc->arg.imm; k++) { putchar((unsigned char) *cell); }     \
+		pc++; goto *pc->handler;                                                                 \
+	inp:                                                                                         \
+		for (unsigned long k = 0; k < pc->arg.imm; k++)                                          \
+		{                                                                                        \
+			const int c = getchar();                                                             \
+			if (c != EOF) { *cell = (type) c; }                                                  \
+			else if (bc->args.eof != EOF_UNCHANGED) { *cell = (type) -(bc->args.eof == EOF_MINUS_ONE); } \
+		}                                                                                        \
+		pc++; goto *pc->handler;                                                                 \
+	dbg:                                                                                         \
+		printf("debbug at %ld chunk-instruction from %d cell:\n", pc->arg.imm - 1, bc->args.offset); \
+		mem->at = (signed long) (cell - tape);                                                   \
+		displayer(mem, bc->args.offset, bc->args.display, bc->args.group);                       \
+		printf("\n\n");                                                                          \
+		pc++; goto *pc->handler;                                                                 \
+	end:                                                                                         \
+		mem->at = (signed long) (cell - tape);                                                   \
+		free(code);                                                                              \
+}
+
+DEFINE_THREADED_ENGINE(emulate_threaded_8,  unsigned char,  display_8)
+DEFINE_THREADED_ENGINE(emulate_threaded_16, unsigned short, display_16)
+DEFINE_THREADED_ENGINE(emulate_threaded_32, unsigned int,   display_32)
+DEFINE_THREADED_ENGINE(emulate_threaded_64, unsigned long,  display_64)
+
+#pragma GCC diagnostic pop
+#endif
+
+static size_t *resolve_jumps (const struct stream *stream)
+{
+	/* every '[' and its ']' share the same 'nolbl' (see lexpa.c), so the
+	 * pairing is resolved once here, then each branch is a single lookup
+	 * while the program runs. 'opens' maps a label to its '[' position
+	 */
+	const unsigned long nolabels = count_labels(stream);
+
+	size_t *jumps = (size_t*) calloc(stream->length + 1, sizeof(size_t));
+	size_t *opens = (size_t*) calloc(nolabels + 1, sizeof(size_t));
+
+	CHECK_POINTER(jumps, "resolving branches to emulate");
+	CHECK_POINTER(opens, "resolving branches to emulate");
+
+	for (size_t i = 0; i < stream->length; i++)
+	{
+		const struct token *t = &stream->stream[i];
+		switch (t->mnemonic)
+		{
+			case '[': opens[t->nolbl] = i; break;
+			case ']':
+			{
+				const size_t open = opens[t->nolbl];
+				jumps[open] = i;
+				jumps[i]    = open;
+				break;
+			}
+		}
+	}
+
+	free(opens);
+	return jumps;
 }
 
 inline static void handle_next (struct token *t, struct Memory *mem)
 {
-	if (mem->safe && ((mem->at + t->groupSize) > mem->tapesz))
+	if (mem->safe && ((mem->at + (signed long) t->groupSize) > mem->tapesz))
 	{
-		fatal_source_fatal(FATAL_BREAKDOWN_TOKEN(t), FATAL_SRC_SAFE_MODE_NEXT_OVERFLOW, FATAL_ISNT_MULTIPLE);
+		fatal_source_fatal(FATAL_BREAKDOWN_LOCATION(locate(t)), FATAL_SRC_SAFE_MODE_NEXT_OVERFLOW, FATAL_ISNT_MULTIPLE);
 	}
-	mem->at += (unsigned int) t->groupSize;
+	mem->at += (signed long) t->groupSize;
+	if (mem->at > mem->highest) { mem->highest = mem->at; }
 }
 
 inline static void handle_prev (struct token *t, struct Memory *mem)
 {
-	const signed long help = mem->at - t->groupSize;
+	const signed long help = mem->at - (signed long) t->groupSize;
 	if (mem->safe && (help < 0))
 	{
-		fatal_source_fatal(FATAL_BREAKDOWN_TOKEN(t), FATAL_SRC_SAFE_MODE_PREV_UNDRFLOW, FATAL_ISNT_MULTIPLE);
+		fatal_source_fatal(FATAL_BREAKDOWN_LOCATION(locate(t)), FATAL_SRC_SAFE_MODE_PREV_UNDRFLOW, FATAL_ISNT_MULTIPLE);
+	}
+	mem->at -= (signed long) t->groupSize;
+	if (mem->at < mem->lowest) { mem->lowest = mem->at; }
+}
+
+static void handle_scan (const struct token *t, struct Memory *mem)
+{
+	/* bytes walked one at a time forward are memchr(3) up to the end of the
+	 * tape; anything else, or when there was no zero in there, steps cell
+	 * by cell (so running off the tape still faults in guard mode)
+	 */
+	const signed long end = mem->unbounded ? (signed long) (UNBOUNDED_TAPE_LENGTH / 2) : (signed long) mem->tapesz;
+	if (mem->cellsz == 1 && t->offset == 1 && mem->at >= 0 && mem->at < end)
+	{
+		unsigned char *tape = (unsigned char*) mem->memory;
+		const unsigned char *zero = (const unsigned char*) memchr(tape + mem->at, 0, (size_t) (end - mem->at));
+		mem->at = zero ? (signed long) (zero - tape) : end;
+	}
+
+	const load_t load = loader_for(mem->cellsz);
+	while (load(mem) != 0) { mem->at += t->offset; }
+	mark_touched(mem);
+}
+
+static load_t loader_for (const unsigned char cellsz)
+{
+	switch (cellsz)
+	{
+		case 2: return load_16;
+		case 4: return load_32;
+		case 8: return load_64;
 	}
-	mem->at -= (unsigned int) t->groupSize;
+	return load_8;
+}
+
+static bool pre_evaluation_goes_on (const struct token *t, struct Memory *mem)
+{
+	/* input and debug dumps belong to the run, anything else goes on while
+	 * the budget lasts and the cells it touches are on the tape (nothing
+	 * else checks bounds while pre-evaluating), a scan is walked ahead
+	 */
+	if (--mem->budget == 0 || t->mnemonic == ',' || t->mnemonic == '@')
+	{
+		return false;
+	}
+
+	const signed long end = (signed long) mem->tapesz;
+	signed long at = mem->at;
+
+	switch (t->mnemonic)
+	{
+		case '>': at += (signed long) t->groupSize; break;
+		case '<': at -= (signed long) t->groupSize; break;
+		case '+':
+		case '-':
+		case MNEMONIC_SET:
+		case MNEMONIC_MUL: at += t->offset; break;
+		case MNEMONIC_SCAN:
+		{
+			const load_t load = loader_for(mem->cellsz);
+			const signed long from = mem->at;
+			while (mem->at >= 0 && mem->at < end && load(mem) != 0) { mem->at += t->offset; }
+
+			at = mem->at;
+			mem->at = from;
+			break;
+		}
+	}
+	return at >= 0 && at < end;
+}
+
+inline static void mark_touched (struct Memory *mem)
+{
+	/* snapshots store only the extent the program touched
+	 */
+	if (mem->at > mem->highest) { mem->highest = mem->at; }
+	if (mem->at < mem->lowest)  { mem->lowest  = mem->at; }
 }
 
 inline static void handle_add8 (struct token *t, struct Memory *mem)
@@ -117,7 +1108,7 @@ inline static void handle_add8 (struct token *t, struct Memory *mem)
 
 	if (mem->safe && (a + t->groupSize) > mem->max)
 	{
-		fatal_source_fatal(FATAL_BREAKDOWN_TOKEN(t), FATAL_SRC_SAFE_MODE_INCS_OVERFLOW, FATAL_ISNT_MULTIPLE);
+		fatal_source_fatal(FATAL_BREAKDOWN_LOCATION(locate(t)), FATAL_SRC_SAFE_MODE_INCS_OVERFLOW, FATAL_ISNT_MULTIPLE);
 	}
 	*byte += (unsigned char) t->groupSize;
 }
@@ -127,7 +1118,7 @@ inline static void handle_dec8 (struct token *t, struct Memory *mem)
 	unsigned char *byte = &(((unsigned char*) mem->memory)[mem->at]);
 	if (mem->safe && *byte == 0)
 	{
-		fatal_source_fatal(FATAL_BREAKDOWN_TOKEN(t), FATAL_SRC_SAFE_MODE_DECS_UNDRFLOW, FATAL_ISNT_MULTIPLE);
+		fatal_source_fatal(FATAL_BREAKDOWN_LOCATION(locate(t)), FATAL_SRC_SAFE_MODE_DECS_UNDRFLOW, FATAL_ISNT_MULTIPLE);
 	}
 	*byte -= (unsigned char) t->groupSize;
 }
@@ -139,7 +1130,7 @@ inline static void handle_add16 (struct token *t, struct Memory *mem)
 
 	if (mem->safe && (a + t->groupSize) > mem->max)
 	{
-		fatal_source_fatal(FATAL_BREAKDOWN_TOKEN(t), FATAL_SRC_SAFE_MODE_INCS_OVERFLOW, FATAL_ISNT_MULTIPLE);
+		fatal_source_fatal(FATAL_BREAKDOWN_LOCATION(locate(t)), FATAL_SRC_SAFE_MODE_INCS_OVERFLOW, FATAL_ISNT_MULTIPLE);
 	}
 	*word += (unsigned short) t->groupSize;
 }
@@ -150,7 +1141,7 @@ inline static void handle_dec16 (struct token *t, struct Memory *mem)
 
 	if (mem->safe && *word == 0)
 	{
-		fatal_source_fatal(FATAL_BREAKDOWN_TOKEN(t), FATAL_SRC_SAFE_MODE_DECS_UNDRFLOW, FATAL_ISNT_MULTIPLE);
+		fatal_source_fatal(FATAL_BREAKDOWN_LOCATION(locate(t)), FATAL_SRC_SAFE_MODE_DECS_UNDRFLOW, FATAL_ISNT_MULTIPLE);
 	}
 	*word -= (unsigned short) t->groupSize;
 }
@@ -162,7 +1153,7 @@ inline static void handle_add32 (struct token *t, struct Memory *mem)
 
 	if (mem->safe && (a + t->groupSize) > mem->max)
 	{
-		fatal_source_fatal(FATAL_BREAKDOWN_TOKEN(t), FATAL_SRC_SAFE_MODE_INCS_OVERFLOW, FATAL_ISNT_MULTIPLE);
+		fatal_source_fatal(FATAL_BREAKDOWN_LOCATION(locate(t)), FATAL_SRC_SAFE_MODE_INCS_OVERFLOW, FATAL_ISNT_MULTIPLE);
 	}
 	*longg += (unsigned int) t->groupSize;
 }
@@ -173,7 +1164,7 @@ inline static void handle_dec32 (struct token *t, struct Memory *mem)
 
 	if (mem->safe && *longg == 0)
 	{
-		fatal_source_fatal(FATAL_BREAKDOWN_TOKEN(t), FATAL_SRC_SAFE_MODE_DECS_UNDRFLOW, FATAL_ISNT_MULTIPLE);
+		fatal_source_fatal(FATAL_BREAKDOWN_LOCATION(locate(t)), FATAL_SRC_SAFE_MODE_DECS_UNDRFLOW, FATAL_ISNT_MULTIPLE);
 	}
 	*longg -= (unsigned int) t->groupSize;
 }
@@ -185,7 +1176,7 @@ inline static void handle_add64 (struct token *t, struct Memory *mem)
 
 	if (mem->safe && (a + t->groupSize) > mem->max)
 	{
-		fatal_source_fatal(FATAL_BREAKDOWN_TOKEN(t), FATAL_SRC_SAFE_MODE_INCS_OVERFLOW, FATAL_ISNT_MULTIPLE);
+		fatal_source_fatal(FATAL_BREAKDOWN_LOCATION(locate(t)), FATAL_SRC_SAFE_MODE_INCS_OVERFLOW, FATAL_ISNT_MULTIPLE);
 	}
 	*quad += (unsigned long) t->groupSize;
 }
@@ -196,11 +1187,23 @@ inline static void handle_dec64 (struct token *t, struct Memory *mem)
 
 	if (mem->safe && *quad == 0)
 	{
-		fatal_source_fatal(FATAL_BREAKDOWN_TOKEN(t), FATAL_SRC_SAFE_MODE_DECS_UNDRFLOW, FATAL_ISNT_MULTIPLE);
+		fatal_source_fatal(FATAL_BREAKDOWN_LOCATION(locate(t)), FATAL_SRC_SAFE_MODE_DECS_UNDRFLOW, FATAL_ISNT_MULTIPLE);
 	}
 	*quad -= (unsigned long) t->groupSize;
 }
 
+inline static unsigned long load_8  (struct Memory *mem) { return ((unsigned char*)  mem->memory)[mem->at]; }
+inline static unsigned long load_16 (struct Memory *mem) { return ((unsigned short*) mem->memory)[mem->at]; }
+
+inline static unsigned long load_32 (struct Memory *mem) { return ((unsigned int*)   mem->memory)[mem->at]; }
+inline static unsigned long load_64 (struct Memory *mem) { return ((unsigned long*)  mem->memory)[mem->at]; }
+
+inline static void store_8  (struct Memory *mem, const unsigned long v) { ((unsigned char*)  mem->memory)[mem->at] = (unsigned char)  v; }
+inline static void store_16 (struct Memory *mem, const unsigned long v) { ((unsigned short*) mem->memory)[mem->at] = (unsigned short) v; }
+
+inline static void store_32 (struct Memory *mem, const unsigned long v) { ((unsigned int*)   mem->memory)[mem->at] = (unsigned int)   v; }
+inline static void store_64 (struct Memory *mem, const unsigned long v) { ((unsigned long*)  mem->memory)[mem->at] = (unsigned long)  v; }
+
 inline static void display_8  (struct Memory *mem, const unsigned int off, const unsigned int dis, const unsigned int group)
 {
 	for (unsigned int i = off, j = 0; i < dis + off; j++)
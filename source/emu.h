@@ -6,6 +6,11 @@
 #define BC_EMU_H
 #include "bc.h"
 
-void emu_emulate (const struct stream*, const unsigned int, const unsigned char, const bool, const unsigned int, const unsigned int, const unsigned int);
+void emu_emulate (const struct bc*);
+
+/* runs the program up to its first input, debug dump or 'budget' tokens and
+ * leaves the machine state in 'image' (see elf.c)
+ */
+void emu_pre_evaluate (const struct bc*, struct image*);
 
 #endif
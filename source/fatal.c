@@ -10,6 +10,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <setjmp.h>
 
 /* 'strerrordesc_np' function returns in fact a string
  * but gcc does not recognize it so better redefine the
@@ -19,6 +20,22 @@ const char* strerrordesc_np(int);
 
 static unsigned short get_proper_context (const char*);
 
+/* with several inputs each one fails on its own (see main.c), the thread
+ * working on it jumps back to 'Recover' instead of ending the process
+ */
+static _Thread_local sigjmp_buf *Recover = NULL;
+
+void fatal_recover_at (sigjmp_buf *point)
+{
+	Recover = point;
+}
+
+void fatal_give_up (void)
+{
+	if (Recover) { siglongjmp(*Recover, 1); }
+	exit(EXIT_FAILURE);
+}
+
 void fatal_file_ops (const char *filename)
 {
 	const char *const fmt =
@@ -27,7 +44,7 @@ void fatal_file_ops (const char *filename)
 	"  file  : %s\n"
 	"  aborting now!\n";
 	fprintf(stderr, fmt, strerrordesc_np(errno), filename);
-	exit(EXIT_FAILURE);
+	fatal_give_up();
 }
 
 void fatal_memory_ops (const char *desc)
@@ -38,14 +55,24 @@ void fatal_memory_ops (const char *desc)
 	"  while : %s\n"
 	"  aborting now!\n";
 	fprintf(stderr, fmt, strerrordesc_np(errno), desc);
-	exit(EXIT_FAILURE);
+	fatal_give_up();
+}
+
+void fatal_snapshot_ops (const char *filename, const char *reason)
+{
+	const char *const fmt =
+	"bc:\x1b[31mfatal:\x1b[0m cannot resume from snapshot\n"
+	"  reason: %s\n"
+	"  file  : %s\n"
+	"  aborting now!\n";
+	fprintf(stderr, fmt, reason, filename);
+	fatal_give_up();
 }
 
-void fatal_source_fatal (const char *context, const unsigned short numline, const unsigned short offline, const enum FatalSourceKind kind, const enum FatalIsMultiple ismul)
+void fatal_source_fatal (const char *context, const unsigned long numline, const unsigned long offline, const enum FatalSourceKind kind, const enum FatalIsMultiple ismul)
 {
 	static const char *const reasons[] =
 	{
-		"bc:\x1b[31mfatal:\x1b[0m max nested loop level reached! What are you even progrmming at this point?\n",
 		"bc:\x1b[31mfatal:\x1b[0m premature opening, defining a ']' without previous '['\n",
 		"bc:\x1b[31mfatal:\x1b[0m undefined closing, a '[' was defined without final ']'\n",
 		"bc:\x1b[31mfatal:\x1b[0msafe-mode: memory overflow\n",
@@ -56,11 +83,11 @@ void fatal_source_fatal (const char *context, const unsigned short numline, cons
 
 	fprintf(stderr, "%s", reasons[kind]);
 	const unsigned short show = get_proper_context(context + 1);
-	fprintf(stderr, "  %-5d \x1b[5m%c\x1b[0m%.*s\n", numline, *context, show, context + 1);
-	fprintf(stderr, "        ~ offset: %d\n", offline);
+	fprintf(stderr, "  %-5lu \x1b[5m%c\x1b[0m%.*s\n", numline, *context, show, context + 1);
+	fprintf(stderr, "        ~ offset: %lu\n", offline);
 	
 	if (ismul == FATAL_IS_MULTIPLE) { fputc(10, stderr); }
-	else { exit(EXIT_FAILURE); }
+	else { fatal_give_up(); }
 }
 
 static unsigned short get_proper_context (const char *cx)
@@ -79,7 +106,12 @@ void fatal_nonfatal_warn (const enum FatalWarningKind kind, ...)
 		"invalid argument for -T (%d), it must be greater than 30000; setting to default (%d)\n\n",
 		"invalid values for -O (%d) and -T (%d), -T must be greater than -O; setting both to default\n\n",
 		"invalid values for -d (%d) and -T (%d) (or maybe -T < -d + -O which is not possible), -T must be greater than -d; setting both to default\n\n",
-		"invalid value for -g (%d), cannot be zero; setting to default (%d)\n\n"
+		"invalid value for -g (%d), cannot be zero; setting to default (%d)\n\n",
+		"an unbounded tape (-U) has no bounds to check; ignoring -s and -G\n\n",
+		"invalid value for -J (%d), cannot be zero; setting to default (%d)\n\n",
+		"pre-evaluation (-p) only applies to ELF output on a bounded tape; ignoring it\n\n",
+		"streaming (-Z) only produces ELF output, without passes nor pre-evaluation; ignoring it\n\n",
+		"invalid value for -e (%s), it can only be keep, 0 or -1; setting to default (keep)\n\n"
 	};
 
 	va_list args;
@@ -5,12 +5,13 @@
 #ifndef BC_FATAL_H
 #define BC_FATAL_H
 
-#define FATAL_BREAKDOWN_TOKEN(t)   t->meta.context, t->meta.numline, t->meta.offline
+#include <setjmp.h>
+
+#define FATAL_BREAKDOWN_LOCATION(l) l->context, l->numline, l->offline
 
 enum FatalSourceKind
 {
-	FATAL_SRC_MAX_NESTED_LEVEL = 0,
-	FATAL_SRC_PREMATURE_OPENING,
+	FATAL_SRC_PREMATURE_OPENING = 0,
 	FATAL_SRC_UNMATCHED_OPEN,
 	FATAL_SRC_SAFE_MODE_NEXT_OVERFLOW,
 	FATAL_SRC_SAFE_MODE_PREV_UNDRFLOW,
@@ -32,12 +33,21 @@ enum FatalWarningKind
 	FATAL_WARN_INVALID_OT,
 	FATAL_WARN_INVALID_dT,
 	FATAL_WARN_INVALID_g,
+	FATAL_WARN_UNBOUNDED_SAFE,
+	FATAL_WARN_INVALID_J,
+	FATAL_WARN_PREEVAL_IGNORED,
+	FATAL_WARN_STREAMING_IGNORED,
+	FATAL_WARN_INVALID_e,
 };
 
+void fatal_recover_at (sigjmp_buf*);
+void fatal_give_up (void);
+
 void fatal_file_ops (const char*);
 void fatal_memory_ops (const char*);
+void fatal_snapshot_ops (const char*, const char*);
 
-void fatal_source_fatal (const char*, const unsigned short, const unsigned short, const enum FatalSourceKind, const enum FatalIsMultiple);
+void fatal_source_fatal (const char*, const unsigned long, const unsigned long, const enum FatalSourceKind, const enum FatalIsMultiple);
 void fatal_nonfatal_warn (const enum FatalWarningKind, ...);
 
 #endif
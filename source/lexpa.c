@@ -6,43 +6,162 @@
 #include "fatal.h"
 
 #include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#endif
 
 #define MAX(a, b)   ((a) > (b) ? (a) : (b))
 
+/* Most bytes of a source are comments and whitespace, runs of them are
+ * skipped by the widest routine the host has ('pick_skipper'). A skipper
+ * starts at a non-command byte and gives the position of the next command
+ * (or 'length'), keeping 'numline' and 'offline' as if every byte had been
+ * walked one at a time
+ */
+typedef size_t (*skipper_t) (const char*, size_t, const size_t, unsigned long*, unsigned long*);
+
+static const bool IsCommand[256] =
+{
+	['+'] = true, ['-'] = true, ['<'] = true, ['>'] = true, [','] = true,
+	['.'] = true, ['['] = true, [']'] = true, ['@'] = true
+};
+
+/* Open loops keep a copy of where they were (a few bytes of source are
+ * enough to report them) since the token itself and the source around it
+ * may be gone by the time the loop closes when streaming
+ */
+struct openLoop
+{
+	char          context[LEXPA_CONTEXT_LENGTH];
+	unsigned int  nolbl;
+	unsigned long numline;
+	unsigned long offline;
+};
+
+/* grows as deep as the source goes (doubling, so deep programs do not
+ * pay for it)
+ */
 struct openLoopStack
 {
-	struct token *stack[OPENLOOP_STACK_MAX_CAP];
-	unsigned short at;
+	struct openLoop *stack;
+	size_t          capacity;
+	size_t          at;
+	unsigned int    nolabels;
 };
 
-static struct token *get_next_token (struct stream*);
-static struct token *handle_accumulative (struct stream*, const char*, const unsigned short, const unsigned short);
+/* Everything the lexer carries from one window of source to the next
+ */
+struct lexer
+{
+	struct openLoopStack stack;
+	struct token         *last;
+	skipper_t            skip;
+	unsigned long        lhsloop;
+	unsigned long        nested;
+	unsigned long        numline;
+	unsigned long        offline;
+};
+
+static struct token *get_next_token (struct stream*, const char*, const unsigned long, const unsigned long);
+static struct token *handle_accumulative (struct stream*, const char*, const unsigned long, const unsigned long);
+
+static void handle_opening (struct openLoopStack*, struct stream*, const char*, const unsigned long, const unsigned long);
+static void handle_closing (struct openLoopStack*, struct stream*, const char*, const unsigned long, const unsigned long);
 
-static void handle_opening (struct openLoopStack*, struct stream*, const char*, const unsigned short, const unsigned short);
-static void handle_closing (struct openLoopStack*, struct stream*, const char*, const unsigned short, const unsigned short);
+static void init_lexer (struct lexer*, struct stream*);
+static void lex_window (struct lexer*, const char*, const size_t, struct stream*);
+static void check_unmatched (const struct lexer*);
+
+static skipper_t pick_skipper (void);
+static size_t skip_scalar (const char*, size_t, const size_t, unsigned long*, unsigned long*);
+
+#if defined(__x86_64__) && defined(__GNUC__)
+static void skip_span (const unsigned long, const unsigned int, unsigned long*, unsigned long*);
+static size_t skip_sse2 (const char*, size_t, const size_t, unsigned long*, unsigned long*);
+static size_t skip_avx2 (const char*, size_t, const size_t, unsigned long*, unsigned long*);
+#endif
 
 void lexpa_lex_n_parse (const char *source, const size_t length, struct stream *stream)
 {
+	struct lexer lexer;
+	init_lexer(&lexer, stream);
+
+	lex_window(&lexer, source, length, stream);
+	check_unmatched(&lexer);
+	free(lexer.stack.stack);
+}
+
+void lexpa_lex_stream (FILE *file, const char *name, struct stream *stream, lexpa_batch_t batch, void *data)
+{
+	struct lexer lexer;
+	init_lexer(&lexer, stream);
+
+	char *window = (char*) calloc(LEXPA_WINDOW_LENGTH + 1, sizeof(char));
+	CHECK_POINTER(window, "reserving space for reading the source code");
+
+	size_t filled = 0;
+	bool eof = false;
+
+	while (!eof)
+	{
+		filled += fread(window + filled, 1, LEXPA_WINDOW_LENGTH - filled, file);
+		if (ferror(file)) { fatal_file_ops(name); }
+
+		eof = feof(file);
+		window[filled] = 0;
+
+		/* the last bytes wait for the next window so anything reported has
+		 * its context right after it; every window is a batch of its own
+		 * (a run of commands split between two is just two tokens)
+		 */
+		const size_t upto = eof ? filled : ((filled > LEXPA_CONTEXT_LENGTH) ? filled - LEXPA_CONTEXT_LENGTH : 0);
+
+		stream->length = 0;
+		lexer.last     = NULL;
+		lex_window(&lexer, window, upto, stream);
+		if (stream->length) { batch(stream, data); }
+
+		memmove(window, window + upto, filled - upto);
+		filled -= upto;
+	}
+
+	check_unmatched(&lexer);
+	free(lexer.stack.stack);
+	free(window);
+}
+
+static void init_lexer (struct lexer *lexer, struct stream *stream)
+{
+	memset(lexer, 0, sizeof(*lexer));
+	lexer->numline = 1;
+	lexer->skip    = pick_skipper();
+
 	stream->length   = 0;
 	stream->capacity = STREAM_GROWTH_FACTOR;
 	stream->stream   = (struct token*) calloc(STREAM_GROWTH_FACTOR, sizeof(struct token));
+	stream->where    = (struct location*) calloc(STREAM_GROWTH_FACTOR, sizeof(struct location));
 	CHECK_POINTER(stream->stream, "reserving storage for tokens");
+	CHECK_POINTER(stream->where, "reserving storage for tokens");
+}
 
-	unsigned short numline = 1, offline = 0;
-	struct token *last = NULL;
-
-	struct openLoopStack stack = {0};
-
-	unsigned long lhsloop = 0, nested = 0;
-
+static void lex_window (struct lexer *lexer, const char *source, const size_t length, struct stream *stream)
+{
 	for (size_t i = 0; i < length; i++)
 	{
+		if (!IsCommand[(unsigned char) source[i]])
+		{
+			i = lexer->skip(source, i, length, &lexer->numline, &lexer->offline);
+			if (i == length) { break; }
+		}
+
 		const char mnemonic = source[i];
 
-		if (last && last->meta.mnemonic == mnemonic)
+		if (lexer->last && lexer->last->mnemonic == mnemonic)
 		{
-			last->groupSize++;
-			offline++;
+			lexer->last->groupSize++;
+			lexer->offline++;
 			continue;
 		}
 
@@ -54,104 +173,219 @@ void lexpa_lex_n_parse (const char *source, const size_t length, struct stream *
 			case '>':
 			case ',':
 			case '.':
-			case '@': { last = handle_accumulative(stream, source + i, numline, offline); break; }
+			case '@': { lexer->last = handle_accumulative(stream, source + i, lexer->numline, lexer->offline); break; }
 
 			case '[':
 			{
-				lhsloop++;
-				nested++;
-				handle_opening(&stack, stream, source + i, numline, offline);
-				last = NULL;
+				lexer->lhsloop++;
+				lexer->nested++;
+				handle_opening(&lexer->stack, stream, source + i, lexer->numline, lexer->offline);
+				lexer->last = NULL;
 				break;
 			}
 			case ']':
 			{
-				handle_closing(&stack, stream, source + i, numline, offline);
-				last = NULL;
-				lhsloop--;
+				handle_closing(&lexer->stack, stream, source + i, lexer->numline, lexer->offline);
+				lexer->last = NULL;
+				lexer->lhsloop--;
 
-				if (lhsloop == 0)
+				if (lexer->lhsloop == 0)
 				{
-					stream->nonested = MAX(stream->nonested, nested);
-					nested = 0;
+					stream->nonested = MAX(stream->nonested, lexer->nested);
+					lexer->nested = 0;
 				}
 				break;
 			}
-			case 10 : { numline++; offline = 0; continue; }
 		}
-		offline++;
+		lexer->offline++;
 	}
+}
 
+static void check_unmatched (const struct lexer *lexer)
+{
 	bool leave = false;
-	for (unsigned short i = 0; i < stack.at; i++)
+	for (size_t i = 0; i < lexer->stack.at; i++)
 	{
-		struct token *e = stack.stack[i];
-		fatal_source_fatal(e->meta.context, e->meta.numline, e->meta.offline, FATAL_SRC_UNMATCHED_OPEN, FATAL_ISNT_MULTIPLE);
+		const struct openLoop *e = &lexer->stack.stack[i];
+		fatal_source_fatal(e->context, e->numline, e->offline, FATAL_SRC_UNMATCHED_OPEN, FATAL_ISNT_MULTIPLE);
 		leave = true;
 	}
 
-	if (leave) { exit(EXIT_FAILURE); }
+	if (leave) { fatal_give_up(); }
 }
 
-static struct token *get_next_token (struct stream *stream)
+static struct token *get_next_token (struct stream *stream, const char *context, const unsigned long numline, const unsigned long offline)
 {
 	if (stream->length == stream->capacity)
 	{
-		stream->capacity += STREAM_GROWTH_FACTOR;
+		stream->capacity *= 2;
 		stream->stream   = (struct token*) realloc(stream->stream, sizeof(struct token) * stream->capacity);
+		stream->where    = (struct location*) realloc(stream->where, sizeof(struct location) * stream->capacity);
 		CHECK_POINTER(stream->stream, "reserving storage for tokens");
+		CHECK_POINTER(stream->where, "reserving storage for tokens");
 	}
+
+	struct location *where = &stream->where[stream->length];
+	where->context = (char*) context;
+	where->numline = numline;
+	where->offline = offline;
+
 	return &stream->stream[stream->length++];
 }
 
-static struct token *handle_accumulative (struct stream *stream, const char *context, const unsigned short numline, const unsigned short offline)
+static struct token *handle_accumulative (struct stream *stream, const char *context, const unsigned long numline, const unsigned long offline)
 {
-	struct token *t = get_next_token(stream);
+	struct token *t = get_next_token(stream, context, numline, offline);
 
-	t->groupSize     = 1;
-	t->meta.numline  = numline;
-	t->meta.offline  = offline;
-	t->meta.mnemonic = *context;
-	t->meta.context  = (char*) context;
+	t->groupSize = 1;
+	t->offset    = 0;
+	t->mnemonic  = *context;
 
 	return t;
 }
 
-static void handle_opening (struct openLoopStack *stack, struct stream *stream, const char *context, const unsigned short numline, const unsigned short offline)
+static void handle_opening (struct openLoopStack *stack, struct stream *stream, const char *context, const unsigned long numline, const unsigned long offline)
 {
-	static unsigned long nolabels = 0;
-
-	if (stack->at == OPENLOOP_STACK_MAX_CAP)
+	if (stack->at == stack->capacity)
 	{
-		fatal_source_fatal(context, numline, offline, FATAL_SRC_MAX_NESTED_LEVEL, FATAL_ISNT_MULTIPLE);
+		stack->capacity = stack->capacity ? 2 * stack->capacity : OPENLOOP_GROWTH_FACTOR;
+		stack->stack    = (struct openLoop*) realloc(stack->stack, sizeof(struct openLoop) * stack->capacity);
+		CHECK_POINTER(stack->stack, "reserving space for open loops");
 	}
 
-	struct token *t = get_next_token(stream);
+	struct token *t = get_next_token(stream, context, numline, offline);
+
+	t->groupSize = 1;
+	t->offset    = 0;
+	t->nolbl     = stack->nolabels++;
+	t->mnemonic  = *context;
 
-	t->groupSize      = 1;
-	t->nolbl          = nolabels++;
-	t->meta.numline   = numline;
-	t->meta.offline   = offline;
-	t->meta.mnemonic  = *context;
-	t->meta.context   = (char*) context;
+	/* up to the end of the source (nul), the rest reads as the end of
+	 * the line
+	 */
+	struct openLoop *open = &stack->stack[stack->at++];
+	memset(open->context, '\n', sizeof(open->context));
+	for (size_t k = 0; k < sizeof(open->context) - 1 && context[k]; k++) { open->context[k] = context[k]; }
 
-	stack->stack[stack->at++] = t;
+	open->nolbl   = t->nolbl;
+	open->numline = numline;
+	open->offline = offline;
 }
 
-static void handle_closing (struct openLoopStack *stack, struct stream *stream, const char *context, const unsigned short numline, const unsigned short offline)
+static void handle_closing (struct openLoopStack *stack, struct stream *stream, const char *context, const unsigned long numline, const unsigned long offline)
 {
 	if (stack->at == 0)
 	{
 		fatal_source_fatal(context, numline, offline, FATAL_SRC_PREMATURE_OPENING, FATAL_ISNT_MULTIPLE);
 	}
 
-	struct token *close   = get_next_token(stream);
-	struct token* open    = stack->stack[--stack->at];
+	struct token *close         = get_next_token(stream, context, numline, offline);
+	const struct openLoop *open = &stack->stack[--stack->at];
 
 	close->nolbl          = open->nolbl;
 	close->groupSize      = 1;
-	close->meta.numline   = numline;
-	close->meta.offline   = offline;
-	close->meta.mnemonic  = *context;
-	close->meta.context   = (char*) context;
+	close->offset         = 0;
+	close->mnemonic       = *context;
+}
+
+static skipper_t pick_skipper (void)
+{
+#if defined(__x86_64__) && defined(__GNUC__)
+	/* SSE2 is always there on amd64
+	 */
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") ? skip_avx2 : skip_sse2;
+#else
+	return skip_scalar;
+#endif
+}
+
+static size_t skip_scalar (const char *source, size_t i, const size_t length, unsigned long *numline, unsigned long *offline)
+{
+	for (; i < length && !IsCommand[(unsigned char) source[i]]; i++)
+	{
+		if (source[i] == 10) { (*numline)++; *offline = 0; }
+		else                 { (*offline)++; }
+	}
+	return i;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+static void skip_span (const unsigned long newlines, const unsigned int span, unsigned long *numline, unsigned long *offline)
+{
+	/* 'newlines' has a bit per newline within the 'span' bytes skipped, the
+	 * column restarts after the last one
+	 */
+	if (newlines == 0)
+	{
+		*offline += span;
+		return;
+	}
+
+	const unsigned int last = 63 - __builtin_clzl(newlines);
+	*numline += __builtin_popcountl(newlines);
+	*offline  = span - last - 1;
+}
+
+static size_t skip_sse2 (const char *source, size_t i, const size_t length, unsigned long *numline, unsigned long *offline)
+{
+	/* commands are '+,-.' (a range), '<' and '>' (one bit apart), '@', '['
+	 * and ']'; a zero 'commands' mask means the whole chunk is skipped
+	 */
+	const __m128i first = _mm_set1_epi8('+'), three = _mm_set1_epi8(3);
+	const __m128i angle = _mm_set1_epi8('>'), two   = _mm_set1_epi8(2);
+	const __m128i at    = _mm_set1_epi8('@'), open  = _mm_set1_epi8('['), close = _mm_set1_epi8(']');
+	const __m128i line  = _mm_set1_epi8(10);
+
+	for (; i + 16 <= length; i += 16)
+	{
+		const __m128i chunk = _mm_loadu_si128((const __m128i*) (source + i));
+		const __m128i rel   = _mm_sub_epi8(chunk, first);
+
+		__m128i hits = _mm_cmpeq_epi8(_mm_min_epu8(rel, three), rel);
+		hits = _mm_or_si128(hits, _mm_cmpeq_epi8(_mm_or_si128(chunk, two), angle));
+		hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, at));
+		hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, open));
+		hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, close));
+
+		const unsigned long commands = (unsigned int) _mm_movemask_epi8(hits);
+		const unsigned long newlines = (unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, line));
+		const unsigned int span = commands ? (unsigned int) __builtin_ctzl(commands) : 16;
+
+		skip_span(newlines & ((1UL << span) - 1), span, numline, offline);
+		if (commands) { return i + span; }
+	}
+	return skip_scalar(source, i, length, numline, offline);
+}
+
+__attribute__((target("avx2")))
+static size_t skip_avx2 (const char *source, size_t i, const size_t length, unsigned long *numline, unsigned long *offline)
+{
+	/* same as 'skip_sse2' over 32 bytes at once
+	 */
+	const __m256i first = _mm256_set1_epi8('+'), three = _mm256_set1_epi8(3);
+	const __m256i angle = _mm256_set1_epi8('>'), two   = _mm256_set1_epi8(2);
+	const __m256i at    = _mm256_set1_epi8('@'), open  = _mm256_set1_epi8('['), close = _mm256_set1_epi8(']');
+	const __m256i line  = _mm256_set1_epi8(10);
+
+	for (; i + 32 <= length; i += 32)
+	{
+		const __m256i chunk = _mm256_loadu_si256((const __m256i*) (source + i));
+		const __m256i rel   = _mm256_sub_epi8(chunk, first);
+
+		__m256i hits = _mm256_cmpeq_epi8(_mm256_min_epu8(rel, three), rel);
+		hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(_mm256_or_si256(chunk, two), angle));
+		hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(chunk, at));
+		hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(chunk, open));
+		hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(chunk, close));
+
+		const unsigned long commands = (unsigned int) _mm256_movemask_epi8(hits);
+		const unsigned long newlines = (unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, line));
+		const unsigned int span = commands ? (unsigned int) __builtin_ctzl(commands) : 32;
+
+		skip_span(newlines & ((1UL << span) - 1), span, numline, offline);
+		if (commands) { return i + span; }
+	}
+	return skip_sse2(source, i, length, numline, offline);
 }
+#endif
@@ -6,6 +6,15 @@
 #define BC_LEXPA_H
 #include "bc.h"
 
+/* streaming: the source is read through a window this long, tokens are
+ * handed to 'lexpa_batch_t' a window at a time (the stream is reused)
+ */
+#define LEXPA_WINDOW_LENGTH    (1 << 16)
+#define LEXPA_CONTEXT_LENGTH   16
+
+typedef void (*lexpa_batch_t) (const struct stream*, void*);
+
 void lexpa_lex_n_parse (const char*, const size_t, struct stream*);
+void lexpa_lex_stream (FILE*, const char*, struct stream*, lexpa_batch_t, void*);
 
 #endif
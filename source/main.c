@@ -8,13 +8,38 @@
 #include "cxa.h"
 #include "fatal.h"
 #include "lexpa.h"
+#include "opt.h"
 
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+
+#define READ_GROWTH_FACTOR      (1 << 16)
+
+/* Batch mode: several inputs are compiled by 'jobs' threads, each one takes
+ * the next pending input until none is left
+ */
+struct batch
+{
+	const struct bc *proto;
+	char            **inputs;
+	size_t          noinputs;
+	size_t          next;
+	size_t          failed;
+	pthread_mutex_t lock;
+};
 
 static size_t read_file (const char*, char**);
+static size_t read_pipe (FILE*, const char*, char**);
 static void check_arguments (struct bc*);
 
+static bool run_input (const struct bc*, char*, const bool);
+static void run_file (const struct bc*, char*, const bool);
+static void derive_output_name (const char*, const char*, char*);
+
+static size_t run_batch (const struct bc*, char**, const size_t);
+static void *batch_worker (void*);
+
 int main (int argc, char **argv)
 {
 	struct bc bc;
@@ -27,8 +52,13 @@ int main (int argc, char **argv)
 	bc.args.offset  = BC_DEFAULT_O;
 	bc.args.display = BC_DEFAULT_d;
 	bc.args.group   = BC_DEFAULT_g;
+	bc.args.hotness = BC_DEFAULT_x;
+	bc.args.profileTop = BC_DEFAULT_P;
+	bc.args.jobs    = BC_DEFAULT_J;
+	bc.args.budget  = BC_DEFAULT_p;
 
 	char *arch = "amd64";
+	char *eof  = "keep";
 	struct CxaFlag flags[] =
 	{
 		CXA_SET_STR("compile", "source to be compiled",                                         &bc.args.compile,  CXA_FLAG_TAKER_YES, 'c'),
@@ -38,47 +68,265 @@ int main (int argc, char **argv)
 		CXA_SET_INT("cell",    "cell size (1 B default. 1,2,4,8 B)",                            &bc.args.cellsz,   CXA_FLAG_TAKER_MAY, 'C'),
 		CXA_SET_CHR("usage",   "displays this message",                                         NULL,              CXA_FLAG_TAKER_NON, 'u'),
 		CXA_SET_CHR("safe",    "enables safe mode",                                             NULL,              CXA_FLAG_TAKER_NON, 's'),
-		CXA_SET_CHR("emu-mem", "emulates memory (disabled by default)",                         NULL,              CXA_FLAG_TAKER_NON, 'E'),
+		CXA_SET_CHR("emu-mem", "runs the program in the emulator (disabled by default)",       NULL,              CXA_FLAG_TAKER_NON, 'E'),
 		CXA_SET_INT("offset",  "print emulated memory from <offset> (0 default)",               &bc.args.offset,   CXA_FLAG_TAKER_MAY, 'O'),
 		CXA_SET_INT("display", "number of cells to display from emulated memory (100 default)", &bc.args.display,  CXA_FLAG_TAKER_MAY, 'd'),
 		CXA_SET_INT("group",   "number of columns to display when emu-mem (10 default)",        &bc.args.group,    CXA_FLAG_TAKER_MAY, 'g'),
 		CXA_SET_STR("arch",    "target archquitecture (amd64 default, amd64 | arm64)",          &arch,             CXA_FLAG_TAKER_MAY, 'A'),
+		CXA_SET_CHR("threaded","emulate with the direct-threaded engine (switch default)",      NULL,              CXA_FLAG_TAKER_NON, 't'),
+		CXA_SET_CHR("jit",     "compile in memory and run right away, no ELF",                  NULL,              CXA_FLAG_TAKER_NON, 'j'),
+		CXA_SET_INT("tiered",  "emulate, compiling loops hotter than <n> (1000 default)",       &bc.args.hotness,  CXA_FLAG_TAKER_MAY, 'x'),
+		CXA_SET_INT("profile", "emulate, report hot lines and top <n> loops (10 default)",     &bc.args.profileTop, CXA_FLAG_TAKER_MAY, 'P'),
+		CXA_SET_CHR("guard",   "safe mode via guard pages, tape bounds only (cells may wrap)",  NULL,              CXA_FLAG_TAKER_NON, 'G'),
+		CXA_SET_CHR("unbound", "tape grows on demand both ways, ignores -T (no bounds checks)", NULL,              CXA_FLAG_TAKER_NON, 'U'),
+		CXA_SET_STR("checkpoint","emulate, snapshot into <file> on SIGUSR1/SIGTERM or -N",     &bc.args.checkpoint, CXA_FLAG_TAKER_YES, 'K'),
+		CXA_SET_LNG("every",   "take a snapshot every <n> tokens (needs -K, 0 default: never)", &bc.args.every,    CXA_FLAG_TAKER_MAY, 'N'),
+		CXA_SET_STR("resume",  "emulate from the snapshot in <file>",                           &bc.args.resume,   CXA_FLAG_TAKER_YES, 'R'),
+		CXA_SET_INT("jobs",    "threads compiling when many files are given (1 default)",       &bc.args.jobs,     CXA_FLAG_TAKER_MAY, 'J'),
+		CXA_SET_CHR("noopt",   "skip the optimisation passes (always skipped on -s and -P)",    NULL,              CXA_FLAG_TAKER_NON, 'n'),
+		CXA_SET_LNG("preeval", "run up to the first input at compile time (<n> steps at most)", &bc.args.budget,   CXA_FLAG_TAKER_MAY, 'p'),
+		CXA_SET_CHR("stream",  "compile through a fixed window, bounded memory (ELF, no passes)", NULL,             CXA_FLAG_TAKER_NON, 'Z'),
+		CXA_SET_STR("eof",     "what ',' leaves once input is over (keep default, keep | 0 | -1)", &eof,            CXA_FLAG_TAKER_MAY, 'e'),
 		CXA_SET_END
 	};
 
-	cxa_clean(cxa_execute((unsigned char) argc, argv, flags, "bc"));
+	struct Cxa *cxa = cxa_execute(argc, argv, flags, "bc");
 	bc.args.arch = (strncmp(arch, "arm64", 5) == 0 ? ARCH_ARM64 : ARCH_AMD64);
+	bc.args.eof  = (strcmp(eof, "0") == 0 ? EOF_ZERO : strcmp(eof, "-1") == 0 ? EOF_MINUS_ONE : EOF_UNCHANGED);
 
-	if (!bc.args.compile || (flags[5].meta & CXA_FLAG_SEEN_MASK))
+	if (bc.args.eof == EOF_UNCHANGED && strcmp(eof, "keep"))
+	{
+		fatal_nonfatal_warn(FATAL_WARN_INVALID_e, eof);
+	}
+
+	/* inputs: '-c' first (if given) then every positional argument
+	 */
+	char **inputs = (char**) calloc(cxa->len + 1, sizeof(char*));
+	CHECK_POINTER(inputs, "collecting input files");
+
+	size_t noinputs = 0;
+	if (bc.args.compile) { inputs[noinputs++] = bc.args.compile; }
+	for (unsigned long i = 0; i < cxa->len; i++) { inputs[noinputs++] = cxa->positional[i]; }
+	cxa_clean(cxa);
+
+	if (!noinputs || (flags[5].meta & CXA_FLAG_SEEN_MASK))
 	{
 		cxa_print_usage("brainfuck compiler - x86_64", flags);
 		return 0;
 	}
 
+	bc.args.assembly = flags[2].meta & CXA_FLAG_SEEN_MASK;
 	bc.args.safeMode = flags[6].meta & CXA_FLAG_SEEN_MASK;
 	bc.args.emulate  = flags[7].meta & CXA_FLAG_SEEN_MASK;
+	bc.args.threaded = flags[12].meta & CXA_FLAG_SEEN_MASK;
+	bc.args.jit      = flags[13].meta & CXA_FLAG_SEEN_MASK;
+	bc.args.tiered   = flags[14].meta & CXA_FLAG_SEEN_MASK;
+	bc.args.profile  = flags[15].meta & CXA_FLAG_SEEN_MASK;
+	bc.args.guard    = flags[16].meta & CXA_FLAG_SEEN_MASK;
+	bc.args.unbounded = flags[17].meta & CXA_FLAG_SEEN_MASK;
+	bc.args.noopt    = flags[22].meta & CXA_FLAG_SEEN_MASK;
+	bc.args.preeval  = flags[23].meta & CXA_FLAG_SEEN_MASK;
+	bc.args.streaming = flags[24].meta & CXA_FLAG_SEEN_MASK;
 	check_arguments(&bc);
 
+	if (bc.args.emulate || bc.args.threaded || bc.args.safeMode || bc.args.tiered || bc.args.profile || bc.args.guard || bc.args.checkpoint || bc.args.resume)
+	{
+		bc.args.emulate = true;
+	}
+
+	/* running programs share stdin and stdout so those go one after the
+	 * other, only compilation is spread across threads
+	 */
+	size_t failed = 0;
+	if (noinputs > 1 && !bc.args.emulate && !bc.args.jit)
+	{
+		failed = run_batch(&bc, inputs, noinputs);
+	}
+	else
+	{
+		for (size_t i = 0; i < noinputs; i++) { failed += !run_input(&bc, inputs[i], noinputs > 1); }
+	}
+
+	free(inputs);
+	return failed ? EXIT_FAILURE : 0;
+}
+
+static bool run_input (const struct bc *proto, char *input, const bool batched)
+{
+	if (!batched)
+	{
+		run_file(proto, input, false);
+		return true;
+	}
+
+	/* with several inputs a bad one is reported and skipped so the rest
+	 * still go through (see 'fatal_give_up'), whatever output it may have
+	 * left half written is removed
+	 */
+	sigjmp_buf recover;
+	if (sigsetjmp(recover, 1))
+	{
+		fatal_recover_at(NULL);
+		if (!proto->args.emulate && !proto->args.jit)
+		{
+			char output[FILENAME_MAX];
+			derive_output_name(input, proto->args.assembly ? ".s" : "", output);
+			remove(output);
+		}
+		return false;
+	}
+
+	fatal_recover_at(&recover);
+	run_file(proto, input, true);
+	fatal_recover_at(NULL);
+	return true;
+}
+
+static void run_file (const struct bc *proto, char *input, const bool batched)
+{
+	struct bc bc = *proto;
+	memset(&bc.stream, 0, sizeof(bc.stream));
+
+	/* with many inputs every output is named after its input, 'dir/foo.bf'
+	 * becomes 'dir/foo' or 'dir/foo.s'
+	 */
+	char output[FILENAME_MAX], source[FILENAME_MAX];
+	if (batched)
+	{
+		derive_output_name(input, "", output);
+		derive_output_name(input, ".s", source);
+		bc.args.output = output;
+		bc.args.source = source;
+	}
+
+	bc.args.compile = input;
+
+	/* the source is never held whole, see 'lexpa_lex_stream'
+	 */
+	if (bc.args.streaming)
+	{
+		FILE *file = strcmp(input, "-") ? fopen(input, "r") : stdin;
+		if (file == NULL) { fatal_file_ops(input); }
+
+		elf_produce_streaming(file, input, bc.args.output, bc.args.tapesz, bc.args.cellsz, bc.args.unbounded, bc.args.eof);
+		if (file != stdin) { fclose(file); }
+		return;
+	}
+
 	bc.length = read_file(bc.args.compile, &bc.source);
 	lexpa_lex_n_parse(bc.source, bc.length, &bc.stream);
 
-	if (bc.args.emulate || bc.args.safeMode)
+	/* safe mode reports overflows as the source would have them, the passes
+	 * would hide some. The profiler counts the source tokens, not what the
+	 * passes folded them into
+	 */
+	if (!bc.args.noopt && !bc.args.safeMode && !bc.args.profile)
 	{
-		emu_emulate(&bc.stream, bc.args.tapesz, bc.args.cellsz, bc.args.safeMode, bc.args.offset, bc.args.display, bc.args.group);
-		return 0;
+		opt_optimise(&bc.stream, bc.args.cellsz, bc.args.tapesz);
 	}
-	if (flags[2].meta & CXA_FLAG_SEEN_MASK)
+
+	if (bc.args.emulate)
 	{
-		asm_gen_asm(&bc.stream, bc.args.source, bc.args.tapesz, bc.args.cellsz, bc.args.arch);
-		return 0;
+		emu_emulate(&bc);
 	}
+	else if (bc.args.jit)
+	{
+		elf_jit(&bc.stream, bc.args.tapesz, bc.args.cellsz, bc.args.unbounded, bc.args.eof);
+	}
+	else if (bc.args.assembly)
+	{
+		asm_gen_asm(&bc.stream, bc.args.source, bc.args.tapesz, bc.args.cellsz, bc.args.arch, bc.args.unbounded, bc.args.eof);
+	}
+	else if (bc.args.preeval)
+	{
+		struct image image;
+		emu_pre_evaluate(&bc, &image);
+		elf_produce(&bc.stream, bc.args.output, bc.args.tapesz, bc.args.cellsz, bc.args.unbounded, bc.args.eof, &image);
 
-	elf_produce(&bc.stream, bc.args.output, bc.args.tapesz, bc.args.cellsz);
-	return 0;
+		free(image.tape);
+		free(image.output);
+	}
+	else
+	{
+		elf_produce(&bc.stream, bc.args.output, bc.args.tapesz, bc.args.cellsz, bc.args.unbounded, bc.args.eof, NULL);
+	}
+
+	free(bc.stream.stream);
+	free(bc.stream.where);
+	free(bc.stream.literals);
+	free(bc.source);
+}
+
+static void derive_output_name (const char *input, const char *extension, char *output)
+{
+	const char *slash = strrchr(input, '/');
+	const char *dot   = strrchr(input, '.');
+
+	/* no extension to replace: 'foo' would be the input itself
+	 */
+	if (dot == NULL || (slash && dot < slash) || dot == input || (slash && dot == slash + 1))
+	{
+		snprintf(output, FILENAME_MAX, "%s%s", input, *extension ? extension : ".out");
+		return;
+	}
+	snprintf(output, FILENAME_MAX, "%.*s%s", (int) (dot - input), input, extension);
+}
+
+static size_t run_batch (const struct bc *proto, char **inputs, const size_t noinputs)
+{
+	struct batch batch = { .proto = proto, .inputs = inputs, .noinputs = noinputs };
+	pthread_mutex_init(&batch.lock, NULL);
+
+	/* the calling thread is one of the workers
+	 */
+	const size_t nothreads = ((proto->args.jobs < noinputs) ? proto->args.jobs : noinputs) - 1;
+	pthread_t *threads = (pthread_t*) calloc(nothreads + 1, sizeof(pthread_t));
+	CHECK_POINTER(threads, "reserving space for worker threads");
+
+	size_t started = 0;
+	for (; started < nothreads; started++)
+	{
+		if (pthread_create(&threads[started], NULL, batch_worker, &batch)) { break; }
+	}
+
+	/* if no thread could be created everything is still compiled here
+	 */
+	batch_worker(&batch);
+
+	for (size_t i = 0; i < started; i++) { pthread_join(threads[i], NULL); }
+	pthread_mutex_destroy(&batch.lock);
+	free(threads);
+	return batch.failed;
+}
+
+static void *batch_worker (void *arg)
+{
+	struct batch *batch = (struct batch*) arg;
+	while (true)
+	{
+		pthread_mutex_lock(&batch->lock);
+		const size_t which = batch->next++;
+		pthread_mutex_unlock(&batch->lock);
+
+		if (which >= batch->noinputs) { break; }
+		if (run_input(batch->proto, batch->inputs[which], true)) { continue; }
+
+		pthread_mutex_lock(&batch->lock);
+		batch->failed++;
+		pthread_mutex_unlock(&batch->lock);
+	}
+	return NULL;
 }
 
 static size_t read_file (const char *filename, char **source)
 {
+	/* '-' is stdin, which may well be a pipe: there is no size to ask for
+	 */
+	if (strcmp(filename, "-") == 0)
+	{
+		return read_pipe(stdin, filename, source);
+	}
+
 	FILE *file = fopen(filename, "r");
 	if (!file)
 	{
@@ -102,6 +350,27 @@ static size_t read_file (const char *filename, char **source)
 	return size;
 }
 
+static size_t read_pipe (FILE *file, const char *filename, char **source)
+{
+	size_t size = 0, capacity = READ_GROWTH_FACTOR;
+	*source = (char*) calloc(capacity + 1, sizeof(char));
+	CHECK_POINTER(*source, "reserving space for reading the source code");
+
+	while (true)
+	{
+		size += fread(*source + size, 1, capacity - size, file);
+		if (ferror(file))     { fatal_file_ops(filename); }
+		if (size < capacity)  { break; }
+
+		capacity *= 2;
+		*source = (char*) realloc(*source, capacity + 1);
+		CHECK_POINTER(*source, "reserving space for reading the source code");
+	}
+
+	(*source)[size] = 0;
+	return size;
+}
+
 static void check_arguments (struct bc *bc)
 {
 	static const unsigned short cellkeyMask = ((1 << 1) | (1 << 2) | (1 << 4) | (1 << 8));
@@ -117,6 +386,33 @@ static void check_arguments (struct bc *bc)
 		bc->args.tapesz = BC_DEFAULT_T;
 	}
 
+	if (bc->args.jobs == 0)
+	{
+		fatal_nonfatal_warn(FATAL_WARN_INVALID_J, bc->args.jobs, BC_DEFAULT_J);
+		bc->args.jobs = BC_DEFAULT_J;
+	}
+	if (bc->args.unbounded && (bc->args.safeMode || bc->args.guard))
+	{
+		fatal_nonfatal_warn(FATAL_WARN_UNBOUNDED_SAFE);
+		bc->args.emulate  = true;
+		bc->args.safeMode = false;
+		bc->args.guard    = false;
+	}
+
+	/* the machine state ends up inside the ELF, nothing else could carry it
+	 */
+	const bool running = bc->args.emulate || bc->args.threaded || bc->args.safeMode || bc->args.tiered || bc->args.profile || bc->args.guard || bc->args.checkpoint || bc->args.resume;
+	if (bc->args.preeval && (running || bc->args.jit || bc->args.assembly || bc->args.unbounded || bc->args.budget == 0))
+	{
+		fatal_nonfatal_warn(FATAL_WARN_PREEVAL_IGNORED);
+		bc->args.preeval = false;
+	}
+	if (bc->args.streaming && (running || bc->args.jit || bc->args.assembly || bc->args.preeval))
+	{
+		fatal_nonfatal_warn(FATAL_WARN_STREAMING_IGNORED);
+		bc->args.streaming = false;
+	}
+
 	if (bc->args.safeMode)
 	{
 		return;
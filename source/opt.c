@@ -0,0 +1,784 @@
+/* bc - brainfuck compiler
+ * Oct 18, 2026
+ * Optimiser (passes over the token stream)
+ */
+#include "opt.h"
+#include "fatal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define MULTIPLY_MAX_TARGETS    16
+#define FOLDING_MAX_OFFSET      (1L << 24)
+
+#define EVALUATION_BUDGET       (1UL << 20)
+#define EVALUATION_MAX_CELLS    (1U << 16)
+
+#define TRACKING_WINDOW         256
+
+/* Compile-time evaluation of the program start: the tape begins all zero so
+ * everything up to the first input (or debug) is known. Writes made by a
+ * top-level loop are logged ('undo') so the loop can be taken back whole
+ * when it cannot be finished
+ */
+struct undo
+{
+	size_t        at;
+	unsigned long value;
+};
+
+struct evaluation
+{
+	unsigned long *tape;
+	struct undo   *log;
+	char          *output;
+	unsigned long mask;
+	unsigned long steps;
+	size_t        nocells;
+	size_t        at;
+	size_t        nonzero;
+	size_t        nolog;
+	size_t        logcap;
+	size_t        outlen;
+	size_t        outcap;
+	bool          logging;
+};
+
+/* Cells known past the program prefix: 'at' indexes the window, which keeps
+ * its place on the tape until the pointer leaves it and everything is
+ * forgotten
+ */
+struct knowledge
+{
+	unsigned long value[TRACKING_WINDOW];
+	bool          known[TRACKING_WINDOW];
+	unsigned long mask;
+	signed long   at;
+};
+
+static void lower_clear_loops (struct stream*);
+static void lower_multiply_loops (struct stream*);
+static void lower_scan_loops (struct stream*);
+static void fold_pointer_moves (struct stream*);
+static void fold_known_prefix (struct stream*, const unsigned char, const unsigned int);
+static void fold_known_cells (struct stream*, const unsigned char);
+static void drop_dead_loops (struct stream*);
+static void drop_dead_tail (struct stream*);
+
+static size_t *pair_brackets (const struct stream*);
+static bool evaluate (struct evaluation*, const struct stream*, const size_t*, const size_t, const size_t);
+static unsigned long *evaluation_cell (struct evaluation*, const signed long);
+static void evaluation_write (struct evaluation*, unsigned long*, const unsigned long);
+static void evaluation_output (struct evaluation*, const char*, const size_t);
+
+static bool track_quiet_token (struct knowledge*, struct token*);
+static bool runs_once (const struct knowledge*, const struct stream*, const size_t, const size_t);
+static unsigned long *known_cell (struct knowledge*, const signed long);
+static void learn_cell (struct knowledge*, const signed long, const bool, const unsigned long);
+static void forget_cells (struct knowledge*);
+
+static size_t match_multiply_loop (const struct stream*, const size_t, signed long*, signed long*, size_t*);
+static bool leaves_zero (const struct token*);
+
+void opt_optimise (struct stream *stream, const unsigned char cellsz, const unsigned int tapesz)
+{
+	lower_clear_loops(stream);
+	lower_multiply_loops(stream);
+	lower_scan_loops(stream);
+	drop_dead_loops(stream);
+	fold_pointer_moves(stream);
+	fold_known_prefix(stream, cellsz, tapesz);
+	fold_known_cells(stream, cellsz);
+	fold_pointer_moves(stream);
+	drop_dead_tail(stream);
+}
+
+static void lower_clear_loops (struct stream *stream)
+{
+	/* '[-]' and '[+]' (any odd amount, which is invertible modulo every cell
+	 * width so the cell always gets to zero) become a single 'set 0'. The
+	 * stream is compacted in place, the new token keeps the '[' location.
+	 * Every pass moves 'where' along with the tokens
+	 */
+	size_t w = 0;
+	for (size_t r = 0; r < stream->length; r++)
+	{
+		struct token *t = &stream->stream[r];
+
+		const bool isclear = (t->mnemonic == '[') && (r + 2 < stream->length)
+			&& (t[1].mnemonic == '-' || t[1].mnemonic == '+')
+			&& (t[1].groupSize & 1)
+			&& (t[2].mnemonic == ']');
+
+		stream->stream[w] = *t;
+		stream->where[w]  = stream->where[r];
+		if (isclear)
+		{
+			stream->stream[w].mnemonic  = MNEMONIC_SET;
+			stream->stream[w].groupSize = 0;
+			r += 2;
+		}
+		w++;
+	}
+	stream->length = w;
+}
+
+static void lower_multiply_loops (struct stream *stream)
+{
+	/* '[->+>+++<<]' is 'cell[p+1] += cell[p]; cell[p+2] += cell[p] * 3',
+	 * then a clear. The brackets are kept so nothing is touched when the
+	 * cell was zero already (targets may lay outside the tape then), the
+	 * loop just runs once. Every target came from one '+' or '-' at least
+	 * so the result is never longer than the loop and the stream is
+	 * compacted in place
+	 */
+	signed long offsets[MULTIPLY_MAX_TARGETS], factors[MULTIPLY_MAX_TARGETS];
+	size_t w = 0;
+
+	for (size_t r = 0; r < stream->length; r++)
+	{
+		struct token *t = &stream->stream[r];
+		size_t notargets = 0;
+		const size_t close = match_multiply_loop(stream, r, offsets, factors, &notargets);
+		const struct location where = stream->where[r];
+
+		stream->where[w]    = where;
+		stream->stream[w++] = *t;
+		if (close == 0) { continue; }
+
+		for (size_t k = 0; k < notargets; k++)
+		{
+			stream->where[w] = where;
+			struct token *mul = &stream->stream[w++];
+			*mul = *t;
+			mul->mnemonic  = MNEMONIC_MUL;
+			mul->groupSize = (unsigned long) factors[k];
+			mul->offset    = offsets[k];
+		}
+
+		stream->where[w] = where;
+		struct token *set = &stream->stream[w++];
+		*set = *t;
+		set->mnemonic  = MNEMONIC_SET;
+		set->groupSize = 0;
+		set->offset    = 0;
+
+		stream->where[w]    = stream->where[close];
+		stream->stream[w++] = stream->stream[close];
+		r = close;
+	}
+	stream->length = w;
+}
+
+static void lower_scan_loops (struct stream *stream)
+{
+	/* '[>]', '[<<]', '[>>>>]'... walk the tape with a fixed stride until a
+	 * zero cell, they become a single '^' whose 'offset' is the stride.
+	 * No guard is needed, a zero cell is found right away
+	 */
+	size_t w = 0;
+	for (size_t r = 0; r < stream->length; r++)
+	{
+		struct token *t = &stream->stream[r];
+
+		const bool isscan = (t->mnemonic == '[') && (r + 2 < stream->length)
+			&& (t[1].mnemonic == '>' || t[1].mnemonic == '<')
+			&& (t[2].mnemonic == ']');
+
+		stream->stream[w] = *t;
+		stream->where[w]  = stream->where[r];
+		if (isscan)
+		{
+			const signed long stride = (signed long) t[1].groupSize;
+			stream->stream[w].mnemonic  = MNEMONIC_SCAN;
+			stream->stream[w].offset    = (t[1].mnemonic == '>') ? stride : -stride;
+			r += 2;
+		}
+		w++;
+	}
+	stream->length = w;
+}
+
+static void fold_pointer_moves (struct stream *stream)
+{
+	/* within straight-line code the pointer is tracked at compile time:
+	 * '>+>++<<-' becomes '+' at 1, '++' at 2 and '-' at 0, no moves. The
+	 * net move is done once, right before anything else (loops, i/o...)
+	 * since those work on the real pointer. Every move emitted replaces
+	 * at least one which was dropped so the stream is compacted in place.
+	 * It runs again once loops were unwrapped, offsets already set add up
+	 */
+	struct token move = {0};
+	struct location moved = {0};
+	signed long virt = 0;
+	size_t w = 0;
+
+	for (size_t r = 0; r < stream->length; r++)
+	{
+		struct token *t = &stream->stream[r];
+		const char mnemonic = t->mnemonic;
+
+		if (mnemonic == '>' || mnemonic == '<')
+		{
+			const signed long amount = (signed long) t->groupSize;
+			const signed long next = virt + ((mnemonic == '>') ? amount : -amount);
+
+			if (next < FOLDING_MAX_OFFSET && next > -FOLDING_MAX_OFFSET)
+			{
+				move  = *t;
+				moved = stream->where[r];
+				virt  = next;
+				continue;
+			}
+		}
+		else if (mnemonic == '+' || mnemonic == '-' || mnemonic == MNEMONIC_SET)
+		{
+			stream->where[w]  = stream->where[r];
+			stream->stream[w] = *t;
+			stream->stream[w++].offset += virt;
+			continue;
+		}
+
+		if (virt)
+		{
+			move.mnemonic  = (virt > 0) ? '>' : '<';
+			move.groupSize = (unsigned long) ((virt > 0) ? virt : -virt);
+			stream->where[w]    = moved;
+			stream->stream[w++] = move;
+			virt = 0;
+		}
+		stream->where[w]    = stream->where[r];
+		stream->stream[w++] = *t;
+	}
+
+	if (virt)
+	{
+		move.mnemonic  = (virt > 0) ? '>' : '<';
+		move.groupSize = (unsigned long) ((virt > 0) ? virt : -virt);
+		stream->where[w]    = moved;
+		stream->stream[w++] = move;
+	}
+	stream->length = w;
+}
+
+static void drop_dead_loops (struct stream *stream)
+{
+	/* the tape starts all zero and a loop is only left on a zero cell, so a
+	 * loop at the very start or right after another loop (or a clear, or a
+	 * scan) never runs: comment loops mostly. Dropping one may leave the
+	 * next one right after a loop as well
+	 */
+	size_t w = 0;
+	for (size_t r = 0; r < stream->length; r++)
+	{
+		const struct token *t = &stream->stream[r];
+		if (t->mnemonic == '[' && (w == 0 || leaves_zero(&stream->stream[w - 1])))
+		{
+			for (unsigned long depth = 1; depth; )
+			{
+				const char mnemonic = stream->stream[++r].mnemonic;
+				if (mnemonic == '[')      { depth++; }
+				else if (mnemonic == ']') { depth--; }
+			}
+			continue;
+		}
+		stream->where[w]    = stream->where[r];
+		stream->stream[w++] = *t;
+	}
+	stream->length = w;
+}
+
+static void drop_dead_tail (struct stream *stream)
+{
+	/* nothing done after the last output, input or debug dump can be seen,
+	 * the straight-line code trailing it goes away. Loops and scans stay,
+	 * one that never ends would be seen
+	 */
+	size_t keep = stream->length;
+	while (keep)
+	{
+		const char mnemonic = stream->stream[keep - 1].mnemonic;
+		if (mnemonic != '+' && mnemonic != '-' && mnemonic != '>' && mnemonic != '<' && mnemonic != MNEMONIC_SET)
+		{
+			break;
+		}
+		keep--;
+	}
+	stream->length = keep;
+}
+
+static bool leaves_zero (const struct token *t)
+{
+	/* tokens after which the current cell is known to be zero
+	 */
+	switch (t->mnemonic)
+	{
+		case ']':
+		case MNEMONIC_SCAN: return true;
+		case MNEMONIC_SET : return t->groupSize == 0 && t->offset == 0;
+	}
+	return false;
+}
+
+static size_t match_multiply_loop (const struct stream *stream, const size_t open, signed long *offsets, signed long *factors, size_t *notargets)
+{
+	/* a loop made out of '+-<>' only, which comes back to where it started
+	 * and whose cell changes by exactly -1 on each iteration (the amount
+	 * of iterations is the cell itself). Gives the position of ']' or 0
+	 */
+	if (stream->stream[open].mnemonic != '[') { return 0; }
+
+	signed long at = 0, self = 0;
+	for (size_t i = open + 1; i < stream->length; i++)
+	{
+		const struct token *t = &stream->stream[i];
+		const signed long amount = (signed long) t->groupSize;
+
+		switch (t->mnemonic)
+		{
+			case '>': at += amount; continue;
+			case '<': at -= amount; continue;
+			case '+':
+			case '-': break;
+			case ']': return ((at == 0) && (self == -1) && *notargets) ? i : 0;
+			default : return 0;
+		}
+
+		const signed long delta = (t->mnemonic == '+') ? amount : -amount;
+		if (at == 0) { self += delta; continue; }
+
+		size_t k = 0;
+		while (k < *notargets && offsets[k] != at) { k++; }
+
+		if (k == *notargets)
+		{
+			if (k == MULTIPLY_MAX_TARGETS) { return 0; }
+			offsets[k] = at;
+			factors[k] = 0;
+			(*notargets)++;
+		}
+		factors[k] += delta;
+	}
+	return 0;
+}
+
+static void fold_known_prefix (struct stream *stream, const unsigned char cellsz, const unsigned int tapesz)
+{
+	/* top-level tokens and whole loops are run at compile time while every
+	 * value is known, within a step budget and while they stay on the tape.
+	 * What they did becomes: one '"' writing all they printed, a '=' per
+	 * non-zero cell and a move to where the pointer was left. When nothing
+	 * follows, only the output matters. The prefix is only folded when the
+	 * result is not longer than what it replaces
+	 */
+	struct evaluation ev = {
+		.mask    = (cellsz == 8) ? ~0UL : ((1UL << (cellsz * 8)) - 1),
+		.nocells = (tapesz < EVALUATION_MAX_CELLS) ? tapesz : EVALUATION_MAX_CELLS
+	};
+
+	ev.tape = (unsigned long*) calloc(ev.nocells + 1, sizeof(unsigned long));
+	CHECK_POINTER(ev.tape, "reserving space to evaluate the program");
+
+	size_t *jumps = pair_brackets(stream);
+	size_t done = 0;
+
+	while (done < stream->length)
+	{
+		const size_t next = (stream->stream[done].mnemonic == '[') ? jumps[done] + 1 : done + 1;
+		const size_t outlen = ev.outlen, at = ev.at;
+
+		ev.nolog   = 0;
+		ev.logging = (next - done) > 1;
+
+		if (evaluate(&ev, stream, jumps, done, next))
+		{
+			done = next;
+			continue;
+		}
+
+		/* taken back newest first so every cell ends up with its oldest value
+		 */
+		while (ev.nolog)
+		{
+			const struct undo *u = &ev.log[--ev.nolog];
+			ev.nonzero += (size_t) (u->value != 0) - (size_t) (ev.tape[u->at] != 0);
+			ev.tape[u->at] = u->value;
+		}
+		ev.outlen = outlen;
+		ev.at     = at;
+		break;
+	}
+
+	const bool finished = (done == stream->length);
+	const size_t folded = (ev.outlen != 0) + (finished ? 0 : ev.nonzero + (ev.at != 0));
+
+	if (done && folded <= done)
+	{
+		struct token base = stream->stream[0];
+		const struct location where = stream->where[0];
+		base.offset = 0;
+		size_t w = 0;
+
+		if (ev.outlen)
+		{
+			stream->literals = (char*) realloc(stream->literals, stream->noliterals + ev.outlen);
+			CHECK_POINTER(stream->literals, "reserving space for literals");
+			memcpy(stream->literals + stream->noliterals, ev.output, ev.outlen);
+
+			struct token *print = &stream->stream[w++];
+			*print = base;
+			print->mnemonic  = MNEMONIC_PRINT;
+			print->groupSize = ev.outlen;
+			print->offset    = (signed long) stream->noliterals;
+			stream->noliterals += ev.outlen;
+		}
+
+		for (size_t k = 0; !finished && k < ev.nocells; k++)
+		{
+			if (ev.tape[k] == 0) { continue; }
+
+			struct token *set = &stream->stream[w++];
+			*set = base;
+			set->mnemonic  = MNEMONIC_SET;
+			set->groupSize = ev.tape[k];
+			set->offset    = (signed long) k;
+		}
+
+		if (!finished && ev.at)
+		{
+			struct token *move = &stream->stream[w++];
+			*move = base;
+			move->mnemonic  = '>';
+			move->groupSize = ev.at;
+		}
+
+		/* everything folded is said to come from the program start
+		 */
+		for (size_t k = 0; k < w; k++) { stream->where[k] = where; }
+
+		memmove(&stream->stream[w], &stream->stream[done], (stream->length - done) * sizeof(struct token));
+		memmove(&stream->where[w],  &stream->where[done],  (stream->length - done) * sizeof(struct location));
+		stream->length = w + stream->length - done;
+	}
+
+	free(jumps);
+	free(ev.tape);
+	free(ev.log);
+	free(ev.output);
+}
+
+static void fold_known_cells (struct stream *stream, const unsigned char cellsz)
+{
+	/* past the prefix cells are still known within straight-line code: the
+	 * tape starts zero, a cell is zero once a loop or a scan is left and
+	 * holds its value after '='. Arithmetic on a known cell becomes '=', a
+	 * '.' of one becomes '"' and a loop on one is dropped when it is zero
+	 * or unwrapped when it runs once. Entering any other loop forgets
+	 * everything, it may be any iteration. A '"' takes in the next one when
+	 * only tape writes and moves lie between, neither can be seen
+	 */
+	struct knowledge k = { .mask = (cellsz == 8) ? ~0UL : ((1UL << (cellsz * 8)) - 1) };
+	for (size_t c = 0; c < TRACKING_WINDOW; c++) { k.known[c] = true; }
+
+	size_t *jumps = pair_brackets(stream);
+	size_t w = 0, print = 0, once = 0;
+	bool joinable = false;
+
+	for (size_t r = 0; r < stream->length; r++)
+	{
+		struct token t = stream->stream[r];
+		const unsigned long *current = known_cell(&k, 0);
+
+		if (t.mnemonic == MNEMONIC_MUL && current && *current == 0) { continue; }
+
+		if (track_quiet_token(&k, &t))
+		{
+			stream->where[w]    = stream->where[r];
+			stream->stream[w++] = t;
+			continue;
+		}
+
+		switch (t.mnemonic)
+		{
+			case '.':
+			{
+				if (current == NULL) { break; }
+
+				if (!joinable)
+				{
+					print = w;
+					stream->where[w]    = stream->where[r];
+					stream->stream[w++] = (struct token) { .mnemonic = MNEMONIC_PRINT, .offset = (signed long) stream->noliterals };
+					joinable = true;
+				}
+
+				stream->literals = (char*) realloc(stream->literals, stream->noliterals + t.groupSize);
+				CHECK_POINTER(stream->literals, "reserving space for literals");
+				memset(stream->literals + stream->noliterals, (int) (*current & 0xff), t.groupSize);
+
+				stream->noliterals += t.groupSize;
+				stream->stream[print].groupSize += t.groupSize;
+				continue;
+			}
+			case MNEMONIC_PRINT:
+			{
+				/* its bytes end the pool when it was just folded (see
+				 * 'fold_known_prefix'), later ones go right after them
+				 */
+				stream->where[w]    = stream->where[r];
+				stream->stream[w++] = t;
+				print    = w - 1;
+				joinable = (size_t) t.offset + t.groupSize == stream->noliterals;
+				continue;
+			}
+			case '[':
+			{
+				if (current && *current == 0)
+				{
+					r = jumps[r];
+					continue;
+				}
+				if (current && runs_once(&k, stream, r, jumps[r]))
+				{
+					once = jumps[r];
+					continue;
+				}
+				forget_cells(&k);
+				break;
+			}
+			case ']':
+			case MNEMONIC_SCAN:
+			{
+				/* the body of a loop running once left its cell zero
+				 */
+				if (t.mnemonic == ']' && r == once) { continue; }
+
+				forget_cells(&k);
+				learn_cell(&k, 0, true, 0);
+				break;
+			}
+			case ',': learn_cell(&k, 0, false, 0); break;
+		}
+
+		joinable = false;
+		stream->where[w]    = stream->where[r];
+		stream->stream[w++] = t;
+	}
+
+	stream->length = w;
+	free(jumps);
+}
+
+static size_t *pair_brackets (const struct stream *stream)
+{
+	/* jumps[i] is the position of the bracket matching the one at 'i'
+	 */
+	size_t *jumps = (size_t*) calloc(stream->length + 1, sizeof(size_t));
+	size_t *opens = (size_t*) calloc(stream->nonested + 1, sizeof(size_t));
+
+	CHECK_POINTER(jumps, "pairing brackets");
+	CHECK_POINTER(opens, "pairing brackets");
+
+	size_t depth = 0;
+	for (size_t i = 0; i < stream->length; i++)
+	{
+		switch (stream->stream[i].mnemonic)
+		{
+			case '[': opens[depth++] = i; break;
+			case ']':
+			{
+				const size_t open = opens[--depth];
+				jumps[open] = i;
+				jumps[i]    = open;
+				break;
+			}
+		}
+	}
+
+	free(opens);
+	return jumps;
+}
+
+static bool evaluate (struct evaluation *ev, const struct stream *stream, const size_t *jumps, const size_t from, const size_t to)
+{
+	for (size_t i = from; i < to; i++)
+	{
+		const struct token *t = &stream->stream[i];
+		if (++ev->steps > EVALUATION_BUDGET) { return false; }
+
+		const unsigned long current = ev->tape[ev->at];
+		unsigned long *cell = evaluation_cell(ev, t->offset);
+
+		switch (t->mnemonic)
+		{
+			case '+':
+			case '-':
+			case MNEMONIC_SET:
+			case MNEMONIC_MUL:
+			{
+				if (cell == NULL) { return false; }
+
+				unsigned long value = t->groupSize;
+				if (t->mnemonic == '+')               { value = *cell + t->groupSize; }
+				else if (t->mnemonic == '-')          { value = *cell - t->groupSize; }
+				else if (t->mnemonic == MNEMONIC_MUL) { value = *cell + current * t->groupSize; }
+
+				evaluation_write(ev, cell, value);
+				break;
+			}
+			case '>':
+			case '<':
+			{
+				ev->at += (t->mnemonic == '>') ? t->groupSize : -t->groupSize;
+				if (ev->at >= ev->nocells) { return false; }
+				break;
+			}
+			case MNEMONIC_SCAN:
+			{
+				while (ev->tape[ev->at] != 0)
+				{
+					ev->at += (size_t) t->offset;
+					if (ev->at >= ev->nocells || ++ev->steps > EVALUATION_BUDGET) { return false; }
+				}
+				break;
+			}
+			case '.':
+			{
+				const char byte = (char) (current & 0xff);
+				for (unsigned long k = 0; k < t->groupSize; k++) { evaluation_output(ev, &byte, 1); }
+				break;
+			}
+			case MNEMONIC_PRINT: evaluation_output(ev, stream->literals + t->offset, t->groupSize); break;
+
+			case '[': if (current == 0) { i = jumps[i]; } break;
+			case ']': if (current != 0) { i = jumps[i]; } break;
+
+			/* input is not known and the debug dump has to happen at runtime
+			 */
+			default: return false;
+		}
+	}
+	return true;
+}
+
+static unsigned long *evaluation_cell (struct evaluation *ev, const signed long offset)
+{
+	/* negative offsets wrap around, those are off the tape as well
+	 */
+	const size_t at = ev->at + (size_t) offset;
+	return (at < ev->nocells) ? &ev->tape[at] : NULL;
+}
+
+static void evaluation_write (struct evaluation *ev, unsigned long *cell, const unsigned long value)
+{
+	if (ev->logging)
+	{
+		if (ev->nolog == ev->logcap)
+		{
+			ev->logcap += STREAM_GROWTH_FACTOR;
+			ev->log = (struct undo*) realloc(ev->log, ev->logcap * sizeof(struct undo));
+			CHECK_POINTER(ev->log, "reserving space to evaluate the program");
+		}
+		ev->log[ev->nolog++] = (struct undo) { .at = (size_t) (cell - ev->tape), .value = *cell };
+	}
+
+	const unsigned long masked = value & ev->mask;
+	ev->nonzero += (size_t) (masked != 0) - (size_t) (*cell != 0);
+	*cell = masked;
+}
+
+static void evaluation_output (struct evaluation *ev, const char *bytes, const size_t length)
+{
+	if (ev->outlen + length > ev->outcap)
+	{
+		ev->outcap = (ev->outcap + length) * 2;
+		ev->output = (char*) realloc(ev->output, ev->outcap);
+		CHECK_POINTER(ev->output, "reserving space to evaluate the program");
+	}
+	memcpy(ev->output + ev->outlen, bytes, length);
+	ev->outlen += length;
+}
+
+static bool track_quiet_token (struct knowledge *k, struct token *t)
+{
+	/* tape writes and moves, the ones nobody can see happening. What they
+	 * leave is learnt and they become '=' when it is known. Anything else
+	 * is left to the caller
+	 */
+	const unsigned long *current = known_cell(k, 0);
+	unsigned long *cell = known_cell(k, t->offset);
+
+	switch (t->mnemonic)
+	{
+		case '+':
+		case '-':
+		case MNEMONIC_MUL:
+		{
+			if (t->mnemonic == MNEMONIC_MUL && current == NULL)
+			{
+				learn_cell(k, t->offset, false, 0);
+				break;
+			}
+			if (cell == NULL) { break; }
+
+			if (t->mnemonic == '+')      { *cell = (*cell + t->groupSize) & k->mask; }
+			else if (t->mnemonic == '-') { *cell = (*cell - t->groupSize) & k->mask; }
+			else                         { *cell = (*cell + *current * t->groupSize) & k->mask; }
+
+			t->mnemonic  = MNEMONIC_SET;
+			t->groupSize = *cell;
+			break;
+		}
+		case MNEMONIC_SET: learn_cell(k, t->offset, true, t->groupSize); break;
+		case '>':
+		case '<':
+		{
+			k->at += (t->mnemonic == '>') ? (signed long) t->groupSize : -(signed long) t->groupSize;
+			if (k->at < 0 || k->at >= TRACKING_WINDOW) { forget_cells(k); }
+			break;
+		}
+		default: return false;
+	}
+	return true;
+}
+
+static bool runs_once (const struct knowledge *k, const struct stream *stream, const size_t open, const size_t close)
+{
+	/* a loop entered on a known cell whose straight-line body leaves that
+	 * cell known zero: lowered multiplications mostly
+	 */
+	struct knowledge trial = *k;
+	for (size_t i = open + 1; i < close; i++)
+	{
+		struct token t = stream->stream[i];
+		if (!track_quiet_token(&trial, &t)) { return false; }
+	}
+
+	const unsigned long *current = known_cell(&trial, 0);
+	return current && *current == 0;
+}
+
+static unsigned long *known_cell (struct knowledge *k, const signed long offset)
+{
+	const signed long at = k->at + offset;
+	return (at >= 0 && at < TRACKING_WINDOW && k->known[at]) ? &k->value[at] : NULL;
+}
+
+static void learn_cell (struct knowledge *k, const signed long offset, const bool known, const unsigned long value)
+{
+	/* cells off the window are never known, nothing to keep
+	 */
+	const signed long at = k->at + offset;
+	if (at < 0 || at >= TRACKING_WINDOW) { return; }
+
+	k->known[at] = known;
+	k->value[at] = value & k->mask;
+}
+
+static void forget_cells (struct knowledge *k)
+{
+	/* the window is centred again so the pointer may go either way
+	 */
+	memset(k->known, 0, sizeof(k->known));
+	k->at = TRACKING_WINDOW / 2;
+}
@@ -0,0 +1,11 @@
+/* bc - brainfuck compiler
+ * Oct 18, 2026
+ * Optimiser (passes over the token stream)
+ */
+#ifndef BC_OPT_H
+#define BC_OPT_H
+#include "bc.h"
+
+void opt_optimise (struct stream*, const unsigned char, const unsigned int);
+
+#endif